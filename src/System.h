@@ -5,6 +5,21 @@
 
 #define winlog log
 
+// The state of the emulated GBA is thread local, so every thread can
+// load and run a game of its own. Options, the ROM pages CPULoadRom maps
+// and tables that never change stay shared. Build with NO_THREAD_STATE
+// for plain globals, where the toolchain has no thread local storage or
+// only one game ever runs, as on the handhelds.
+#ifdef NO_THREAD_STATE
+#define THREAD_STATE
+#define THREAD_STATE_INIT
+#else
+#define THREAD_STATE __thread
+// For thread local state initialized with the address of other thread
+// local state, or with a constructor
+#define THREAD_STATE_INIT thread_local
+#endif
+
 class SoundDriver;
 
 struct EmulatedSystem {
@@ -54,12 +69,17 @@ extern void systemDrawScreen();
 extern bool systemReadJoypads();
 // return information about the given joystick, -1 for default joystick
 extern uint32_t systemReadJoypad(int);
+// the same for reads between frames, leaving autofire where it was
+extern uint32_t systemPollJoypad(int);
 extern uint32_t systemGetClock();
 extern void systemMessage(int, const char *, ...);
 extern void systemSetTitle(const char *);
 extern SoundDriver *systemSoundInit();
 extern void systemOnWriteDataToSoundBuffer(const uint16_t *finalWave, int length);
 extern void systemOnSoundShutdown();
+// wakes the sound thread / waits for it to make progress (see soundSetThreaded)
+extern void systemSoundThreadNotify();
+extern void systemSoundThreadWait();
 extern void systemScreenMessage(const char *);
 extern void systemUpdateMotionSensor();
 extern int systemGetSensorX();
@@ -85,8 +105,8 @@ extern int systemGreenShift;
 extern int systemBlueShift;
 extern int systemColorDepth;
 extern int systemVerbose;
-extern int systemFrameSkip;
-extern int systemSaveUpdateCounter;
+extern THREAD_STATE int systemFrameSkip;
+extern THREAD_STATE int systemSaveUpdateCounter;
 extern int systemSpeed;
 #define SYSTEM_SAVE_UPDATED 30
 #define SYSTEM_SAVE_NOT_UPDATED 0
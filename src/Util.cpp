@@ -48,10 +48,10 @@ extern int systemBlueShift;
 extern uint16_t systemColorMap16[0x10000];
 extern uint32_t systemColorMap32[0x10000];
 
-static int(ZEXPORT *utilGzWriteFunc)(gzFile, const voidp, unsigned int) = NULL;
-static int(ZEXPORT *utilGzReadFunc)(gzFile, voidp, unsigned int) = NULL;
-static int(ZEXPORT *utilGzCloseFunc)(gzFile) = NULL;
-static z_off_t(ZEXPORT *utilGzSeekFunc)(gzFile, z_off_t, int) = NULL;
+static THREAD_STATE int(ZEXPORT *utilGzWriteFunc)(gzFile, const voidp, unsigned int) = NULL;
+static THREAD_STATE int(ZEXPORT *utilGzReadFunc)(gzFile, voidp, unsigned int) = NULL;
+static THREAD_STATE int(ZEXPORT *utilGzCloseFunc)(gzFile) = NULL;
+static THREAD_STATE z_off_t(ZEXPORT *utilGzSeekFunc)(gzFile, z_off_t, int) = NULL;
 
 bool FileExists(const char *filename)
 {
@@ -374,7 +374,7 @@ bool utilWriteBMPFile(const char *fileName, int w, int h, uint8_t *pix)
         return true;
 }
 
-extern bool cpuIsMultiBoot;
+extern THREAD_STATE bool cpuIsMultiBoot;
 
 bool utilIsGBAImage(const char *file)
 {
@@ -606,6 +606,46 @@ uint8_t *utilLoad(const char *file, bool (*accept)(const char *), uint8_t *data,
         return image;
 }
 
+// Copies the image out of an archive into outFile, a chunk at a time so
+// it never has to fit in memory. Returns its size, 0 on failure.
+int utilUnpack(const char *file, bool (*accept)(const char *), const char *outFile)
+{
+        char buffer[2048];
+        fex_t *fe = scan_arc(file, accept, buffer);
+        if (!fe)
+                return 0;
+
+        FILE *f = fopen(outFile, "wb");
+        if (!f) {
+                systemMessage(MSG_ERROR_CREATING_FILE, N_("Error creating file %s"), outFile);
+                fex_close(fe);
+                return 0;
+        }
+
+        fex_stat(fe);
+        int size = fex_size(fe);
+        uint8_t chunk[0x10000];
+
+        for (int done = 0; done < size;) {
+                int n = size - done < (int)sizeof chunk ? size - done : (int)sizeof chunk;
+                fex_err_t err = fex_read(fe, chunk, n);
+                if (err || fwrite(chunk, 1, n, f) != (size_t)n) {
+                        systemMessage(MSG_ERROR_READING_IMAGE,
+                                      N_("Error reading image from %s: %s"),
+                                      buffer,
+                                      err ? err : "write failed");
+                        size = 0;
+                        break;
+                }
+                done += n;
+        }
+
+        if (fclose(f) != 0)
+                size = 0;
+        fex_close(fe);
+        return size;
+}
+
 void replaceAll(std::string &str, const std::string &from, const std::string &to)
 {
         if (from.empty())
@@ -667,6 +707,58 @@ void utilExtract(const char *filepath, const char *filename)
         fex_close(fex);
 }
 
+void utilWriteIntMem(uint8_t *&data, int val)
+{
+        memcpy(data, &val, sizeof(int));
+        data += sizeof(int);
+}
+
+void utilWriteMem(uint8_t *&data, const void *in_data, unsigned size)
+{
+        memcpy(data, in_data, size);
+        data += size;
+}
+
+void utilWriteDataMem(uint8_t *&data, variable_desc *desc)
+{
+        while (desc->address) {
+                utilWriteMem(data, desc->address, desc->size);
+                desc++;
+        }
+}
+
+unsigned utilDataSize(const variable_desc *desc)
+{
+        unsigned size = 0;
+        while (desc->address) {
+                size += desc->size;
+                desc++;
+        }
+        return size;
+}
+
+int utilReadIntMem(const uint8_t *&data)
+{
+        int res;
+        memcpy(&res, data, sizeof(int));
+        data += sizeof(int);
+        return res;
+}
+
+void utilReadMem(void *buf, const uint8_t *&data, unsigned size)
+{
+        memcpy(buf, data, size);
+        data += size;
+}
+
+void utilReadDataMem(const uint8_t *&data, variable_desc *desc)
+{
+        while (desc->address) {
+                utilReadMem(desc->address, data, desc->size);
+                desc++;
+        }
+}
+
 void utilWriteInt(gzFile gzFile, int i)
 {
         utilGzWrite(gzFile, &i, sizeof(int));
@@ -748,51 +840,83 @@ long utilGzMemTell(gzFile file)
         return memtell(file);
 }
 
-void utilGBAFindSave(const int size)
-{
-        uint32_t *p = (uint32_t *)&rom[0];
-        uint32_t *end = (uint32_t *)(&rom[0] + size);
-        int detectedSaveType = 0;
-        int flashSize = 0x10000;
-        bool rtcFound = false;
+// Words per block compared at once; a block with no candidate in it is
+// skipped as a whole
+static const int SAVE_SCAN_BLOCK = 64;
 
-        while (p < end) {
-                uint32_t d = READ32LE(p);
+static void utilGBAMatchSave(const uint32_t *p, int &detectedSaveType, int &flashSize,
+                             bool &rtcFound)
+{
+        uint32_t d = READ32LE(p);
 
-                if (d == 0x52504545) {
-                        if (memcmp(p, "EEPROM_", 7) == 0) {
-                                if (detectedSaveType == 0 || detectedSaveType == 4)
-                                        detectedSaveType = 1;
+        if (d == 0x52504545) {
+                if (memcmp(p, "EEPROM_", 7) == 0) {
+                        if (detectedSaveType == 0 || detectedSaveType == 4)
+                                detectedSaveType = 1;
+                }
+        } else if (d == 0x4D415253) {
+                if (memcmp(p, "SRAM_", 5) == 0) {
+                        if (detectedSaveType == 0 || detectedSaveType == 1 ||
+                            detectedSaveType == 4)
+                                detectedSaveType = 2;
+                }
+        } else if (d == 0x53414C46) {
+                if (memcmp(p, "FLASH1M_", 8) == 0) {
+                        if (detectedSaveType == 0) {
+                                detectedSaveType = 3;
+                                flashSize = 0x20000;
                         }
-                } else if (d == 0x4D415253) {
-                        if (memcmp(p, "SRAM_", 5) == 0) {
-                                if (detectedSaveType == 0 || detectedSaveType == 1 ||
-                                    detectedSaveType == 4)
-                                        detectedSaveType = 2;
+                } else if (memcmp(p, "FLASH512_", 9) == 0) {
+                        if (detectedSaveType == 0) {
+                                detectedSaveType = 3;
+                                flashSize = 0x10000;
                         }
-                } else if (d == 0x53414C46) {
-                        if (memcmp(p, "FLASH1M_", 8) == 0) {
-                                if (detectedSaveType == 0) {
-                                        detectedSaveType = 3;
-                                        flashSize = 0x20000;
-                                }
-                        } else if (memcmp(p, "FLASH512_", 9) == 0) {
-                                if (detectedSaveType == 0) {
-                                        detectedSaveType = 3;
-                                        flashSize = 0x10000;
-                                }
-                        } else if (memcmp(p, "FLASH", 5) == 0) {
-                                if (detectedSaveType == 0) {
-                                        detectedSaveType = 4;
-                                        flashSize = 0x10000;
-                                }
+                } else if (memcmp(p, "FLASH", 5) == 0) {
+                        if (detectedSaveType == 0) {
+                                detectedSaveType = 4;
+                                flashSize = 0x10000;
                         }
-                } else if (d == 0x52494953) {
-                        if (memcmp(p, "SIIRTC_V", 8) == 0)
-                                rtcFound = true;
                 }
-                p++;
+        } else if (d == 0x52494953) {
+                if (memcmp(p, "SIIRTC_V", 8) == 0)
+                        rtcFound = true;
         }
+}
+
+int utilGBAScanSave(const uint8_t *data, int size, int &flashSize, bool &rtcFound)
+{
+        const uint32_t *p = (const uint32_t *)data;
+        const uint32_t *end = (const uint32_t *)(data + size);
+        int detectedSaveType = 0;
+
+        // the four signatures' first words, as loaded on this host
+        uint32_t eepr, sram, flas, siir;
+        memcpy(&eepr, "EEPR", 4);
+        memcpy(&sram, "SRAM", 4);
+        memcpy(&flas, "FLAS", 4);
+        memcpy(&siir, "SIIR", 4);
+
+        flashSize = 0x10000;
+        rtcFound = false;
+
+        while (end - p >= SAVE_SCAN_BLOCK) {
+                // No branches in here, so the compiler can test several
+                // words per instruction
+                uint32_t hit = 0;
+                for (int i = 0; i < SAVE_SCAN_BLOCK; i++) {
+                        uint32_t d = p[i];
+                        hit |= (d == eepr) | (d == sram) | (d == flas) | (d == siir);
+                }
+
+                if (hit) {
+                        for (int i = 0; i < SAVE_SCAN_BLOCK; i++)
+                                utilGBAMatchSave(p + i, detectedSaveType, flashSize, rtcFound);
+                }
+                p += SAVE_SCAN_BLOCK;
+        }
+        while (p < end)
+                utilGBAMatchSave(p++, detectedSaveType, flashSize, rtcFound);
+
         // if no matches found, then set it to NONE
         if (detectedSaveType == 0) {
                 detectedSaveType = 5;
@@ -800,12 +924,26 @@ void utilGBAFindSave(const int size)
         if (detectedSaveType == 4) {
                 detectedSaveType = 3;
         }
+        return detectedSaveType;
+}
+
+void utilGBASetSave(int type, int flashSize, bool rtcFound)
+{
         rtcEnable(rtcFound);
         rtcEnableRumble(!rtcFound);
-        saveType = detectedSaveType;
+        saveType = type;
         flashSetSize(flashSize);
 }
 
+void utilGBAFindSave(const int size)
+{
+        int flashSize;
+        bool rtcFound;
+        int type = utilGBAScanSave(rom, size, flashSize, rtcFound);
+
+        utilGBASetSave(type, flashSize, rtcFound);
+}
+
 void utilUpdateSystemColorMaps(bool lcd)
 {
         switch (systemColorDepth) {
@@ -24,23 +24,30 @@ bool utilIsZipFile(const char *);
 void utilStripDoubleExtension(const char *, char *);
 IMAGE_TYPE utilFindType(const char *);
 uint8_t *utilLoad(const char *, bool (*)(const char *), uint8_t *, int &);
+int utilUnpack(const char *, bool (*)(const char *), const char *);
 void utilExtract(const char *filepath, const char *filename);
 
 void utilPutDword(uint8_t *, uint32_t);
 void utilPutWord(uint8_t *, uint16_t);
 void utilGBAFindSave(const int);
+// What utilGBAFindSave finds and applies, split for callers caching it:
+// the save type (1 EEPROM, 2 SRAM, 3 Flash, 5 none), Flash size and RTC.
+int utilGBAScanSave(const uint8_t *data, int size, int &flashSize, bool &rtcFound);
+void utilGBASetSave(int type, int flashSize, bool rtcFound);
 void utilUpdateSystemColorMaps(bool lcd = false);
 bool utilFileExists(const char *filename);
 
-#ifdef __LIBRETRO__
 void utilWriteIntMem(uint8_t *&data, int);
 void utilWriteMem(uint8_t *&data, const void *in_data, unsigned size);
 void utilWriteDataMem(uint8_t *&data, variable_desc *);
+// Bytes utilWriteDataMem writes for a table, read from the table alone
+unsigned utilDataSize(const variable_desc *);
 
 int utilReadIntMem(const uint8_t *&data);
 void utilReadMem(void *buf, const uint8_t *&data, unsigned size);
 void utilReadDataMem(const uint8_t *&data, variable_desc *);
-#else
+
+#ifndef __LIBRETRO__
 gzFile utilGzOpen(const char *file, const char *mode);
 gzFile utilMemGzOpen(char *memory, int available, const char *mode);
 int utilGzWrite(gzFile file, const voidp buffer, unsigned int len);
@@ -28,7 +28,7 @@ void Gb_Apu::treble_eq( blip_eq_t const& eq )
 	med_synth .treble_eq( eq );
 }
 
-inline int Gb_Apu::calc_output( int osc ) const
+int Gb_Apu::calc_output( int osc ) const
 {
 	int bits = regs [stereo_reg - start_addr] >> osc;
 	return (bits >> 3 & 2) | (bits & 1);
@@ -194,6 +194,21 @@ Gb_Apu::Gb_Apu()
 
 void Gb_Apu::run_until_( blip_time_t end_time )
 {
+	// A disabled channel outputs a constant level and only keeps its timers
+	// running, and nothing but a register write can re-enable it. Run those
+	// over the whole span at once so the loop below only steps the frame
+	// sequencer and the channels that are actually playing.
+	int busy = 0;
+	if ( square1.enabled || square1.sweep_pending() ) busy |= 1;
+	if ( square2.enabled ) busy |= 2;
+	if ( wave   .enabled ) busy |= 4;
+	if ( noise  .enabled ) busy |= 8;
+
+	if ( !(busy & 1) ) square1.run( last_time, end_time );
+	if ( !(busy & 2) ) square2.run( last_time, end_time );
+	if ( !(busy & 4) ) wave   .run( last_time, end_time );
+	if ( !(busy & 8) ) noise  .run( last_time, end_time );
+
 	while ( true )
 	{
 		// run oscillators
@@ -201,10 +216,13 @@ void Gb_Apu::run_until_( blip_time_t end_time )
 		if ( time > frame_time )
 			time = frame_time;
 
-		square1.run( last_time, time );
-		square2.run( last_time, time );
-		wave   .run( last_time, time );
-		noise  .run( last_time, time );
+		if ( busy )
+		{
+			if ( busy & 1 ) square1.run( last_time, time );
+			if ( busy & 2 ) square2.run( last_time, time );
+			if ( busy & 4 ) wave   .run( last_time, time );
+			if ( busy & 8 ) noise  .run( last_time, time );
+		}
 		last_time = time;
 
 		if ( time == end_time )
@@ -7,6 +7,7 @@
 #include "Gb_Oscs.h"
 
 struct gb_apu_state_t;
+struct gb_apu_snapshot_t;
 
 class Gb_Apu
 {
@@ -87,6 +88,12 @@ class Gb_Apu
         // Loads state. You should call reset() BEFORE this.
         blargg_err_t load_state(gb_apu_state_t const &in);
 
+        // Saves the state along with the current amplitudes and time, so
+        // load_snapshot() can put this same APU back exactly where it was
+        // without adding anything to the buffers. Outputs aren't touched.
+        void save_snapshot(gb_apu_snapshot_t *out);
+        void load_snapshot(gb_apu_snapshot_t const &in);
+
         public:
         Gb_Apu();
 
@@ -189,4 +196,11 @@ struct gb_apu_state_t {
         val_t unused[13]; // for future expansion
 };
 
+// In-memory only, see Gb_Apu::save_snapshot()
+struct gb_apu_snapshot_t {
+        gb_apu_state_t state;
+        int last_time;
+        int last_amp[Gb_Apu::osc_count];
+};
+
 #endif
@@ -117,3 +117,26 @@ blargg_err_t Gb_Apu::load_state( gb_apu_state_t const& in )
 	return 0;
 }
 
+void Gb_Apu::save_snapshot( gb_apu_snapshot_t* out )
+{
+	save_state( &out->state );
+	out->last_time = last_time;
+	for ( int i = 0; i < osc_count; i++ )
+		out->last_amp [i] = oscs [i]->last_amp;
+}
+
+void Gb_Apu::load_snapshot( gb_apu_snapshot_t const& in )
+{
+	(void) save_load( CONST_CAST(gb_apu_state_t*,&in.state), false );
+	save_load2( CONST_CAST(gb_apu_state_t*,&in.state), false );
+	last_time = in.last_time;
+
+	// the buffers still hold these amplitudes, so nothing is silenced
+	for ( int i = 0; i < osc_count; i++ )
+	{
+		Gb_Osc& o = *oscs [i];
+		o.last_amp = in.last_amp [i];
+		o.output   = o.outputs [calc_output( i )];
+	}
+	apply_volume();
+}
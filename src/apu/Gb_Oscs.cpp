@@ -538,10 +538,12 @@ void Gb_Noise::run( blip_time_t time, blip_time_t end_time )
 		}
 		else if ( !vol )
 		{
-			// Maintain phase when not playing
+			// Maintain phase when not playing. A disabled channel's LFSR is
+			// reset on trigger, so it doesn't need to be run at all.
 			int count = (end_time - time + per - 1) / per;
 			time += (blip_time_t) count * per;
-			bits = run_lfsr( bits, ~mask, count );
+			if ( enabled )
+				bits = run_lfsr( bits, ~mask, count );
 		}
 		else
 		{
@@ -115,6 +115,12 @@ class Gb_Sweep_Square : public Gb_Square
         void clock_sweep();
         void write_register(int frame_phase, int reg, int old_data, int data);
 
+        // True if clock_sweep() may still change the frequency
+        bool sweep_pending() const
+        {
+                return sweep_enabled && (regs[0] & period_mask) && (regs[0] & shift_mask);
+        }
+
         void reset()
         {
                 sweep_freq = 0;
@@ -0,0 +1,391 @@
+// VisualBoyAdvance - Nintendo Gameboy/GameboyAdvance (TM) emulator.
+// Copyright (C) 2015 VBA-M development team
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or(at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+// Runs a set of ROMs for a number of frames each, on as many threads as
+// there are CPUs, and checks a hash of every frame's picture and sound
+// against the golden file recorded for the ROM before. For telling that a
+// change to the core left what games do alone.
+//
+// Input is scripted by a ROM.input file next to the ROM, if there is one:
+// lines of a frame number and the buttons held from that frame on, e.g.
+// "120 START" or "300 A RIGHT". A frame with no buttons releases them all,
+// and # starts a comment.
+//
+// Golden files are ROM.golden, or kept in the directory given with -g:
+// one line per frame of its number, the picture hash and the sound hash.
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <getopt.h>
+
+#include "../lib/libvbam.h"
+
+struct Script_Entry {
+	int frame;
+	uint32_t buttons;
+};
+
+struct Run {
+	const char *rom;
+	// filled in by the worker
+	int frames;
+	double seconds;
+	int mismatches;
+	int firstMismatch;
+	bool videoMismatch;
+	bool audioMismatch;
+	const char *error;
+};
+
+static int frames = 600;
+static bool record = false;
+static const char *goldenDir = NULL;
+
+static Run *runs;
+static int runCount;
+static int nextRun = 0;
+
+static const struct {
+	const char *name;
+	uint32_t button;
+} buttonNames[] = {
+	{ "A", VBAM_BUTTON_A },
+	{ "B", VBAM_BUTTON_B },
+	{ "SELECT", VBAM_BUTTON_SELECT },
+	{ "START", VBAM_BUTTON_START },
+	{ "RIGHT", VBAM_BUTTON_RIGHT },
+	{ "LEFT", VBAM_BUTTON_LEFT },
+	{ "UP", VBAM_BUTTON_UP },
+	{ "DOWN", VBAM_BUTTON_DOWN },
+	{ "R", VBAM_BUTTON_R },
+	{ "L", VBAM_BUTTON_L },
+};
+
+static uint64_t hash(const void *data, size_t size)
+{
+	const uint8_t *p = (const uint8_t *)data;
+	uint64_t h = 1469598103934665603ULL; // FNV-1a
+
+	for (size_t i = 0; i < size; i++) {
+		h ^= p[i];
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+static double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static char *loadFile(const char *name, long *size)
+{
+	FILE *f = fopen(name, "rb");
+	if (!f)
+		return NULL;
+
+	char *data = NULL;
+	if (fseek(f, 0, SEEK_END) == 0 && (*size = ftell(f)) > 0) {
+		rewind(f);
+		data = (char *)malloc(*size);
+		if (data && fread(data, 1, *size, f) != (size_t)*size) {
+			free(data);
+			data = NULL;
+		}
+	}
+	fclose(f);
+	return data;
+}
+
+// Reads ROM.input into entries sorted by frame, returns how many
+static int loadScript(const char *rom, Script_Entry **entries)
+{
+	char name[2048];
+	snprintf(name, sizeof name, "%s.input", rom);
+
+	*entries = NULL;
+	FILE *f = fopen(name, "r");
+	if (!f)
+		return 0;
+
+	int count = 0;
+	char line[1024];
+	while (fgets(line, sizeof line, f)) {
+		char *p = strchr(line, '#');
+		if (p)
+			*p = 0;
+
+		char *token = strtok(line, " \t\r\n");
+		if (!token)
+			continue;
+
+		Script_Entry entry = { atoi(token), 0 };
+		while ((token = strtok(NULL, " \t\r\n"))) {
+			for (size_t i = 0; i < sizeof buttonNames / sizeof *buttonNames; i++)
+				if (!strcasecmp(token, buttonNames[i].name))
+					entry.buttons |= buttonNames[i].button;
+		}
+
+		// kept sorted, a later line for the same frame wins
+		int i = count;
+		while (i > 0 && (*entries)[i - 1].frame > entry.frame)
+			i--;
+		if (i > 0 && (*entries)[i - 1].frame == entry.frame) {
+			(*entries)[i - 1] = entry;
+			continue;
+		}
+		*entries = (Script_Entry *)realloc(*entries, (count + 1) * sizeof **entries);
+		memmove(*entries + i + 1, *entries + i, (count - i) * sizeof **entries);
+		(*entries)[i] = entry;
+		count++;
+	}
+	fclose(f);
+	return count;
+}
+
+static void goldenName(const char *rom, char *name, size_t size)
+{
+	if (goldenDir) {
+		const char *base = strrchr(rom, '/');
+		snprintf(name, size, "%s/%s.golden", goldenDir, base ? base + 1 : rom);
+	} else
+		snprintf(name, size, "%s.golden", rom);
+}
+
+// Picture and sound hash of every frame, two per frame
+static uint64_t *loadGolden(const char *rom, int *count)
+{
+	char name[2048];
+	goldenName(rom, name, sizeof name);
+
+	FILE *f = fopen(name, "r");
+	if (!f)
+		return NULL;
+
+	uint64_t *golden = (uint64_t *)calloc(2 * frames, sizeof *golden);
+	int frame;
+	unsigned long long video, audio;
+	*count = 0;
+	while (fscanf(f, "%d %llx %llx", &frame, &video, &audio) == 3) {
+		if (frame < 0 || frame >= frames)
+			continue;
+		golden[2 * frame] = video;
+		golden[2 * frame + 1] = audio;
+		if (frame >= *count)
+			*count = frame + 1;
+	}
+	fclose(f);
+	return golden;
+}
+
+static bool saveGolden(const char *rom, const uint64_t *hashes)
+{
+	char name[2048];
+	goldenName(rom, name, sizeof name);
+
+	FILE *f = fopen(name, "w");
+	if (!f)
+		return false;
+
+	for (int i = 0; i < frames; i++)
+		fprintf(f, "%d %016llx %016llx\n", i,
+		    (unsigned long long)hashes[2 * i], (unsigned long long)hashes[2 * i + 1]);
+	return fclose(f) == 0;
+}
+
+static void runRom(Run *run)
+{
+	long size;
+	char *data = loadFile(run->rom, &size);
+	if (!data) {
+		run->error = "can't read the ROM";
+		return;
+	}
+	bool loaded = vbam_load_rom(data, (int)size, NULL);
+	free(data);
+	if (!loaded) {
+		run->error = "can't load the ROM";
+		return;
+	}
+
+	Script_Entry *script;
+	int scriptLength = loadScript(run->rom, &script);
+
+	int goldenFrames = 0;
+	uint64_t *golden = record ? NULL : loadGolden(run->rom, &goldenFrames);
+	uint64_t *hashes = (uint64_t *)malloc(2 * frames * sizeof *hashes);
+
+	uint32_t buttons = 0;
+	int entry = 0;
+	double start = now();
+	for (int i = 0; i < frames; i++) {
+		while (entry < scriptLength && script[entry].frame <= i)
+			buttons = script[entry++].buttons;
+
+		vbam_step(1, buttons);
+
+		int count;
+		const int16_t *audio = vbam_audio(&count);
+		hashes[2 * i] = hash(vbam_video(), VBAM_WIDTH * VBAM_HEIGHT * sizeof(uint16_t));
+		hashes[2 * i + 1] = hash(audio, count * 2 * sizeof *audio);
+	}
+	run->seconds = now() - start;
+	run->frames = frames;
+	vbam_unload();
+
+	if (record) {
+		if (!saveGolden(run->rom, hashes))
+			run->error = "can't write the golden file";
+	} else if (!golden)
+		run->error = "no golden file";
+	else {
+		for (int i = 0; i < frames; i++) {
+			bool video = i >= goldenFrames || hashes[2 * i] != golden[2 * i];
+			bool audio = i >= goldenFrames || hashes[2 * i + 1] != golden[2 * i + 1];
+			if (!video && !audio)
+				continue;
+			if (!run->mismatches++)
+				run->firstMismatch = i;
+			run->videoMismatch |= video;
+			run->audioMismatch |= audio;
+		}
+	}
+
+	free(hashes);
+	free(golden);
+	free(script);
+}
+
+static void *worker(void *)
+{
+	int i;
+	while ((i = __atomic_fetch_add(&nextRun, 1, __ATOMIC_RELAXED)) < runCount)
+		runRom(&runs[i]);
+	return NULL;
+}
+
+static void usage(const char *name)
+{
+	printf("Usage: %s [options] rom...\n"
+	       "\n"
+	       "Runs every ROM for a number of frames and compares the hashes of\n"
+	       "each frame's picture and sound with ROM.golden.\n"
+	       "\n"
+	       "  -f N   frames to run each ROM for, 600 by default\n"
+	       "  -g DIR keep the golden files in DIR instead of next to the ROMs\n"
+	       "  -j N   ROMs to run at once, the number of CPUs by default\n"
+	       "  -r     record the golden files instead of checking them\n",
+	    name);
+}
+
+int main(int argc, char **argv)
+{
+	int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	int op;
+
+	while ((op = getopt(argc, argv, "f:g:j:rh")) != -1) {
+		switch (op) {
+		case 'f':
+			frames = atoi(optarg);
+			break;
+		case 'g':
+			goldenDir = optarg;
+			break;
+		case 'j':
+			threads = atoi(optarg);
+			break;
+		case 'r':
+			record = true;
+			break;
+		default:
+			usage(argv[0]);
+			return op == 'h' ? 0 : 2;
+		}
+	}
+	if (optind == argc || frames <= 0) {
+		usage(argv[0]);
+		return 2;
+	}
+
+	runCount = argc - optind;
+	runs = (Run *)calloc(runCount, sizeof *runs);
+	for (int i = 0; i < runCount; i++)
+		runs[i].rom = argv[optind + i];
+
+	if (threads < 1)
+		threads = 1;
+	if (threads > runCount)
+		threads = runCount;
+
+	// The stack the core is used to having on the main thread, where the
+	// default for threads is much less (128 KB on musl)
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setstacksize(&attr, 8 << 20);
+
+	double start = now();
+	pthread_t *pool = (pthread_t *)malloc(threads * sizeof *pool);
+	for (int i = 0; i < threads; i++)
+		if (pthread_create(&pool[i], &attr, worker, NULL)) {
+			fprintf(stderr, "Can't start thread %d\n", i);
+			return 2;
+		}
+	for (int i = 0; i < threads; i++)
+		pthread_join(pool[i], NULL);
+	double seconds = now() - start;
+
+	int failed = 0;
+	long totalFrames = 0;
+	for (int i = 0; i < runCount; i++) {
+		Run *run = &runs[i];
+		totalFrames += run->frames;
+
+		printf("%s: ", run->rom);
+		if (run->frames)
+			printf("%d frames, %.0f fps, ", run->frames,
+			    run->seconds > 0 ? run->frames / run->seconds : 0.0);
+
+		if (run->error) {
+			failed++;
+			printf("%s\n", run->error);
+		} else if (record)
+			printf("recorded\n");
+		else if (run->mismatches) {
+			failed++;
+			printf("%d frames differ, the first at %d (%s%s%s)\n",
+			    run->mismatches, run->firstMismatch,
+			    run->videoMismatch ? "picture" : "",
+			    run->videoMismatch && run->audioMismatch ? ", " : "",
+			    run->audioMismatch ? "sound" : "");
+		} else
+			printf("ok\n");
+	}
+
+	printf("%d ROMs, %d failed, %ld frames in %.2f s on %d threads (%.0f fps)\n",
+	    runCount, failed, totalFrames, seconds, threads,
+	    seconds > 0 ? totalFrames / seconds : 0.0);
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,282 @@
+// VisualBoyAdvance - Nintendo Gameboy/GameboyAdvance (TM) emulator.
+// Copyright (C) 2015 VBA-M development team
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or(at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "BackgroundWriter.h"
+#include "../Util.h"
+
+// Writes queued before the emulator has to wait for the thread
+static const size_t QUEUE_JOBS = 16;
+
+struct BackgroundWriter::Job {
+	enum { GZ, PNG, BMP };
+
+	int type;
+	char fileName[2048];
+	uint8_t *data;
+	unsigned size;
+	int width;
+	int height;
+};
+
+BackgroundWriter::BackgroundWriter():
+	_thread(NULL),
+	_semTodo(NULL),
+	_semDone(NULL),
+	_quit(false),
+	_submitted(0),
+	_completed(0)
+{
+	_failedName[0] = 0;
+	_failedNow[0] = 0;
+}
+
+BackgroundWriter::~BackgroundWriter()
+{
+	stop();
+}
+
+bool BackgroundWriter::start()
+{
+	stop();
+
+	_todo.reset(QUEUE_JOBS);
+	_done.reset(QUEUE_JOBS);
+	_semTodo = SDL_CreateSemaphore(0);
+	_semDone = SDL_CreateSemaphore(0);
+	_submitted = _completed = 0;
+	_quit = false;
+
+	_thread = SDL_CreateThread(threadMain, this);
+	if (!_thread) {
+		systemMessage(0, "Failed to start file writer thread: %s", SDL_GetError());
+		stop();
+		return false;
+	}
+
+	return true;
+}
+
+void BackgroundWriter::stop()
+{
+	if (_thread) {
+		_quit = true;
+		SDL_SemPost(_semTodo);
+		SDL_WaitThread(_thread, NULL);
+		_thread = NULL;
+	}
+
+	// Failures nobody asked about any more
+	Job *job;
+	while (_done.pop(job)) {
+		free(job->data);
+		free(job);
+	}
+
+	SDL_DestroySemaphore(_semTodo);
+	SDL_DestroySemaphore(_semDone);
+	_semTodo = NULL;
+	_semDone = NULL;
+}
+
+#ifndef _WIN32
+// So the rename can't reach the disk before the data does
+static bool syncFile(const char *fileName)
+{
+	int fd = open(fileName, O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	bool ok = fsync(fd) == 0;
+	close(fd);
+	return ok;
+}
+#endif
+
+bool BackgroundWriter::run(Job *job)
+{
+	char tempName[sizeof job->fileName + 4];
+	bool ok = false;
+
+	snprintf(tempName, sizeof tempName, "%s.tmp", job->fileName);
+
+	switch (job->type) {
+	case Job::GZ: {
+		gzFile gz = gzopen(tempName, "wb");
+		if (gz) {
+			ok = gzwrite(gz, job->data, job->size) == (int)job->size;
+			if (gzclose(gz) != Z_OK)
+				ok = false;
+		}
+	} break;
+	case Job::PNG:
+		ok = utilWritePNGFile(tempName, job->width, job->height, job->data);
+		break;
+	case Job::BMP:
+		ok = utilWriteBMPFile(tempName, job->width, job->height, job->data);
+		break;
+	}
+
+#ifndef _WIN32
+	if (ok)
+		ok = syncFile(tempName);
+#else
+	if (ok)
+		remove(job->fileName);
+#endif
+	if (ok)
+		ok = rename(tempName, job->fileName) == 0;
+	if (!ok)
+		remove(tempName);
+
+	return ok;
+}
+
+// On the thread: keeps the job for failed() if it failed, frees it otherwise
+void BackgroundWriter::finish(Job *job)
+{
+	if (!run(job) && _done.push(job))
+		return;
+
+	free(job->data);
+	free(job);
+}
+
+void BackgroundWriter::submit(Job *job)
+{
+	if (_thread) {
+		// Only when the disk is far behind; writing this one here instead
+		// could race the thread over the same file
+		while (!_todo.push(job)) {
+			SDL_SemPost(_semTodo);
+			SDL_SemWaitTimeout(_semDone, 10);
+		}
+		_submitted++;
+		SDL_SemPost(_semTodo);
+		return;
+	}
+
+	// _done only has the thread as producer, so this one is kept aside
+	if (!run(job))
+		snprintf(_failedNow, sizeof _failedNow, "%s", job->fileName);
+	free(job->data);
+	free(job);
+}
+
+BackgroundWriter::Job *BackgroundWriter::newJob(int type, const char *fileName, uint8_t *data)
+{
+	Job *job = data ? (Job *)malloc(sizeof(Job)) : NULL;
+	if (!job) {
+		free(data);
+		return NULL;
+	}
+
+	job->type = type;
+	snprintf(job->fileName, sizeof job->fileName, "%s", fileName);
+	job->data = data;
+	job->size = 0;
+	job->width = 0;
+	job->height = 0;
+	return job;
+}
+
+void BackgroundWriter::writeGz(const char *fileName, uint8_t *data, unsigned size)
+{
+	Job *job = newJob(Job::GZ, fileName, data);
+	if (job) {
+		job->size = size;
+		submit(job);
+	}
+}
+
+void BackgroundWriter::writePNG(const char *fileName, uint8_t *data, int w, int h)
+{
+	Job *job = newJob(Job::PNG, fileName, data);
+	if (job) {
+		job->width = w;
+		job->height = h;
+		submit(job);
+	}
+}
+
+void BackgroundWriter::writeBMP(const char *fileName, uint8_t *data, int w, int h)
+{
+	Job *job = newJob(Job::BMP, fileName, data);
+	if (job) {
+		job->width = w;
+		job->height = h;
+		submit(job);
+	}
+}
+
+void BackgroundWriter::wait()
+{
+	while (_thread && __atomic_load_n(&_completed, __ATOMIC_ACQUIRE) != _submitted)
+		SDL_SemWaitTimeout(_semDone, 10);
+}
+
+const char *BackgroundWriter::failed()
+{
+	if (_failedNow[0]) {
+		snprintf(_failedName, sizeof _failedName, "%s", _failedNow);
+		_failedNow[0] = 0;
+		return _failedName;
+	}
+
+	Job *job;
+	if (!_done.pop(job))
+		return NULL;
+
+	snprintf(_failedName, sizeof _failedName, "%s", job->fileName);
+	free(job->data);
+	free(job);
+	return _failedName;
+}
+
+void BackgroundWriter::drain()
+{
+	Job *job;
+
+	while (_todo.pop(job)) {
+		finish(job);
+		__atomic_add_fetch(&_completed, 1, __ATOMIC_RELEASE);
+		SDL_SemPost(_semDone);
+	}
+}
+
+int BackgroundWriter::threadMain(void *data)
+{
+	BackgroundWriter *writer = reinterpret_cast<BackgroundWriter *>(data);
+
+	while (!writer->_quit) {
+		SDL_SemWaitTimeout(writer->_semTodo, 100);
+		writer->drain();
+	}
+
+	// Whatever was queued before stop() was called
+	writer->drain();
+
+	return 0;
+}
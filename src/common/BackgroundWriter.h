@@ -0,0 +1,82 @@
+// VisualBoyAdvance - Nintendo Gameboy/GameboyAdvance (TM) emulator.
+// Copyright (C) 2015 VBA-M development team
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or(at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#ifndef __VBA_BACKGROUND_WRITER_H__
+#define __VBA_BACKGROUND_WRITER_H__
+
+#include "spscqueue.h"
+#include "../System.h"
+
+#include <SDL/SDL.h>
+
+/**
+ * Writes savestates and screenshots from a background thread.
+ * The caller captures what it wants written into a malloc'ed buffer and
+ * hands it over; compression, PNG encoding, fsync and the rename over the
+ * old file all happen on the thread, so the emulator never waits on the
+ * disk. Files are written to a temporary name first, so a crash or a
+ * full card leaves the previous file intact.
+ */
+class BackgroundWriter
+{
+public:
+	BackgroundWriter();
+	~BackgroundWriter();
+
+	bool start();
+	// Finishes everything queued before returning
+	void stop();
+
+	// These take ownership of data, which must come from malloc().
+	// Without the thread they write right away.
+	// gzip compresses size bytes of data into fileName
+	void writeGz(const char *fileName, uint8_t *data, unsigned size);
+	// data is laid out as pix, in systemColorDepth
+	void writePNG(const char *fileName, uint8_t *data, int w, int h);
+	void writeBMP(const char *fileName, uint8_t *data, int w, int h);
+
+	// Waits for queued writes, before reading back a file that may be one
+	void wait();
+
+	// Name of the next file that could not be written, NULL if none.
+	// Valid until the next call.
+	const char *failed();
+
+private:
+	struct Job;
+
+	SpscQueue<Job *> _todo;
+	SpscQueue<Job *> _done;
+	char _failedName[2048];
+	char _failedNow[2048]; // a write done without the thread
+
+	SDL_Thread *_thread;
+	SDL_sem *_semTodo;
+	SDL_sem *_semDone;
+	volatile bool _quit;
+	unsigned _submitted;
+	unsigned _completed; // written by the thread
+
+	static int threadMain(void *data);
+	static Job *newJob(int type, const char *fileName, uint8_t *data);
+	void submit(Job *job);
+	void finish(Job *job);
+	void drain();
+	static bool run(Job *job);
+};
+
+#endif // __VBA_BACKGROUND_WRITER_H__
@@ -47,6 +47,7 @@ enum named_opts
 	OPT_AUTO_FRAME_SKIP,
 	OPT_AVI_RECORD_DIR,
 	OPT_BATTERY_DIR,
+	OPT_BENCHMARK,
 	OPT_BIOS_FILE_NAME_GB,
 	OPT_BIOS_FILE_NAME_GBA,
 	OPT_BIOS_FILE_NAME_GBC,
@@ -76,9 +77,13 @@ enum named_opts
 	OPT_LINK_NUM_PLAYERS,
 	OPT_LINK_TIMEOUT,
 	OPT_MAX_SCALE,
+	OPT_MOVIE_PLAY,
 	OPT_MOVIE_RECORD_DIR,
 	OPT_OPT_FLASH_SIZE,
 	OPT_REWIND_TIMER,
+	OPT_RUN_AHEAD,
+	OPT_ROM_CACHE_DIR,
+	OPT_ROM_CACHE_SIZE,
 	OPT_ROM_DIR_GB,
 	OPT_ROM_DIR_GBA,
 	OPT_ROM_DIR_GBC,
@@ -108,7 +113,7 @@ char path[2048];
 
 dictionary* preferences;
 
-bool cpuIsMultiBoot = false;
+THREAD_STATE bool cpuIsMultiBoot = false;
 bool mirroringEnable = true;
 bool parseDebug = true;
 bool speedHack = false;
@@ -121,7 +126,9 @@ const char* biosFileNameGBC;
 const char* loadDotCodeFile;
 const char* saveDotCodeFile;
 const char* linkHostAddr;
+const char* moviePlayFile;
 const char* movieRecordDir;
+const char* romCacheDir;
 char* rewindMemory = NULL;
 const char* romDirGB;
 const char* romDirGBA;
@@ -139,13 +146,15 @@ int autoLoadMostRecent;
 int autoPatch;
 int autoSaveLoadCheatList;
 int aviRecording;
+int benchmarkFrames;
 int captureFormat = 0;
 int cheatsEnabled = false;
 int cpuDisableSfx = false;
-int cpuSaveType = 0;
+THREAD_STATE int cpuSaveType = 0;
 int disableMMX;
 int disableStatusMessages = 0;
 int dsoundDisableHardwareAcceleration;
+int fastForwardAudio;
 int filterHeight;
 int filterMagnification;
 int filterMT; // enable multi-threading for pixel filters
@@ -167,19 +176,16 @@ int glFilter;
 int ifbType = kIFBNone;
 int joypadDefault;
 int languageOption;
-int layerEnable = 0xff00;
-int layerSettings = 0xff00;
+THREAD_STATE int layerEnable = 0xff00;
+THREAD_STATE int layerSettings = 0xff00;
 int linkAuto;
 int linkHacks = 1;
 int linkMode;
 int linkNumPlayers;
 int linkTimeout = 1;
 int maxScale;
+int mmapBattery;
 int mouseCounter = 0;
-int movieFrame;
-int moviePlayFrame;
-int moviePlaying;
-int movieRecording;
 int openGL;
 int optFlashSize;
 int optPrintUsage;
@@ -194,8 +200,13 @@ int rewindPos;
 int rewindSaveNeeded = 0;
 int rewindTimer = 0;
 int rewindTopPos;
-int rtcEnabled;
-int saveType = 0;
+int pollKeyInput;
+int presentThread;
+int romCacheSize;
+int romPaging;
+THREAD_STATE int rtcEnabled;
+int runAhead = 0;
+THREAD_STATE int saveType = 0;
 int screenMessage;
 int sensorX;
 int sensorY;
@@ -208,13 +219,14 @@ int skipBios = 0;
 int skipSaveGameBattery = false;
 int skipSaveGameCheats = false;
 int soundRecording;
+int soundThread;
 int speedupToggle;
 int sunBars;
 int surfaceSizeX;
 int surfaceSizeY;
 int threadPriority;
 int tripleBuffering;
-int useBios = 0;
+THREAD_STATE int useBios = 0;
 int useBiosFileGB;
 int useBiosFileGBA;
 int useBiosFileGBC;
@@ -229,8 +241,6 @@ int winGbPrinterEnabled;
 int winPauseNextFrame;
 int* rewindSerials = NULL;
 uint32_t autoFrameSkipLastTime;
-uint32_t movieLastJoypad;
-uint32_t movieNextJoypad;
 int throttle;
 
 const char* preparedCheatCodes[MAX_CHEATS];
@@ -261,6 +271,7 @@ struct option argOptions[] = {
 	{ "autofire", required_argument, 0, OPT_AUTOFIRE },
 	{ "avi-record-dir", required_argument, 0, OPT_AVI_RECORD_DIR },
 	{ "battery-dir", required_argument, 0, OPT_BATTERY_DIR },
+	{ "benchmark", required_argument, 0, OPT_BENCHMARK },
 	{ "bios", required_argument, 0, 'b' },
 	{ "bios-file-name-gb", required_argument, 0, OPT_BIOS_FILE_NAME_GB },
 	{ "bios-file-name-gba", required_argument, 0, OPT_BIOS_FILE_NAME_GBA },
@@ -278,6 +289,7 @@ struct option argOptions[] = {
 	{ "dotcode-file-name-load", required_argument, 0, OPT_DOTCODE_FILE_NAME_LOAD },
 	{ "dotcode-file-name-save", required_argument, 0, OPT_DOTCODE_FILE_NAME_SAVE },
 	{ "emulator-type", required_argument, 0, OPT_EMULATOR_TYPE },
+	{ "fast-forward-audio", no_argument, &fastForwardAudio, 1 },
 	{ "filter", required_argument, 0, 'f' },
 	{ "filter-enable-multi-threading", no_argument, &filterMT, 1 },
 	{ "filter-mt", no_argument, &filterMT, 1 },
@@ -312,6 +324,8 @@ struct option argOptions[] = {
 	{ "link-num-players", required_argument, 0, OPT_LINK_NUM_PLAYERS },
 	{ "link-timeout", required_argument, 0, OPT_LINK_TIMEOUT },
 	{ "max-scale", required_argument, 0, OPT_MAX_SCALE },
+	{ "mmap-battery", no_argument, &mmapBattery, 1 },
+	{ "movie-play", required_argument, 0, OPT_MOVIE_PLAY },
 	{ "movie-record-dir", required_argument, 0, OPT_MOVIE_RECORD_DIR },
 	{ "no-agb-print", no_argument, &agbPrint, 0 },
 	{ "no-auto-frameskip", no_argument, &autoFrameSkip, 0 },
@@ -321,20 +335,27 @@ struct option argOptions[] = {
 	{ "no-pause-when-inactive", no_argument, &pauseWhenInactive, 0 },
 	{ "no-rtc", no_argument, &rtcEnabled, 0 },
 	{ "no-show-speed", no_argument, &showSpeed, 0 },
+	{ "no-throttle", no_argument, &throttle, 0 },
 	{ "opengl", required_argument, 0, 'O' },
 	{ "opengl-bilinear", no_argument, &openGL, 2 },
 	{ "opengl-nearest", no_argument, &openGL, 1 },
 	{ "opt-flash-size", required_argument, 0, OPT_OPT_FLASH_SIZE },
 	{ "patch", required_argument, 0, 'i' },
 	{ "pause-when-inactive", no_argument, &pauseWhenInactive, 1 },
+	{ "poll-keyinput", no_argument, &pollKeyInput, 1 },
+	{ "present-thread", no_argument, &presentThread, 1 },
 	{ "profile", optional_argument, 0, 'p' },
 	{ "recent-freeze", no_argument, &recentFreeze, 1 },
 	{ "rewind-timer", required_argument, 0, OPT_REWIND_TIMER },
+	{ "rom-cache-dir", required_argument, 0, OPT_ROM_CACHE_DIR },
+	{ "rom-cache-size", required_argument, 0, OPT_ROM_CACHE_SIZE },
 	{ "rom-dir-gb", required_argument, 0, OPT_ROM_DIR_GB },
 	{ "rom-dir-gba", required_argument, 0, OPT_ROM_DIR_GBA },
 	{ "rom-dir-gbc", required_argument, 0, OPT_ROM_DIR_GBC },
+	{ "rom-paging", no_argument, &romPaging, 1 },
 	{ "rtc", no_argument, &rtcEnabled, 1 },
 	{ "rtc-enabled", required_argument, 0, OPT_RTC_ENABLED },
+	{ "run-ahead", required_argument, 0, OPT_RUN_AHEAD },
 	{ "save-auto", no_argument, &cpuSaveType, 0 },
 	{ "save-dir", required_argument, 0, OPT_SAVE_DIR },
 	{ "save-eeprom", no_argument, &cpuSaveType, 1 },
@@ -353,6 +374,7 @@ struct option argOptions[] = {
 	{ "skip-save-game-cheats", no_argument, &skipSaveGameCheats, 1 },
 	{ "sound-filtering", required_argument, 0, OPT_SOUND_FILTERING },
 	{ "sound-record-dir", required_argument, 0, OPT_SOUND_RECORD_DIR },
+	{ "sound-thread", no_argument, &soundThread, 1 },
 	{ "stretch", no_argument, &fullScreenStretch, 1 },
 	{ "synchronize", required_argument, 0, OPT_SYNCHRONIZE },
 	{ "thread-priority", required_argument, 0, OPT_THREAD_PRIORITY },
@@ -420,6 +442,8 @@ void ValidateConfig()
 		showSpeed = 1;
 	if (rewindTimer < 0 || rewindTimer > 600)
 		rewindTimer = 0;
+	if (runAhead < 0 || runAhead > 6)
+		runAhead = 0;
 	if (autoFireMaxCount < 1)
 		autoFireMaxCount = 1;
 
@@ -448,6 +472,7 @@ void LoadConfig()
 	cpuSaveType = ReadPrefHex("saveType");
 	disableMMX = ReadPref("disableMMX", 0);
 	disableStatusMessages = ReadPrefHex("disableStatus");
+	fastForwardAudio = ReadPref("fastForwardAudio", 0);
 	filterMT = ReadPref("filterEnableMultiThreading", 0);
 	filter = ReadPref("filter", 0);
 	frameSkip = ReadPref("frameSkip", 0);
@@ -472,15 +497,22 @@ void LoadConfig()
 	linkTimeout = ReadPref("LinkTimeout", 1);
 	loadDotCodeFile = ReadPrefString("loadDotCodeFile");
 	maxScale = ReadPref("maxScale", 0);
+	mmapBattery = ReadPref("mmapBattery", 0);
 	movieRecordDir = ReadPrefString("movieRecordDir");
 	openGL = ReadPrefHex("openGL");
 	optFlashSize = ReadPrefHex("flashSize");
 	pauseWhenInactive = ReadPref("pauseWhenInactive", 1);
+	pollKeyInput = ReadPref("pollKeyInput", 0);
+	presentThread = ReadPref("presentThread", 0);
 	recentFreeze = ReadPref("recentFreeze", 0);
 	rewindTimer = ReadPref("rewindTimer", 0);
+	runAhead = ReadPref("runAhead", 0);
+	romCacheDir = ReadPrefString("romCacheDir");
+	romCacheSize = ReadPref("romCacheSize", 256);
 	romDirGB = ReadPrefString("romDirGB");
 	romDirGBA = ReadPrefString("romDirGBA");
 	romDirGBC = ReadPrefString("romDirGBC");
+	romPaging = ReadPref("romPaging", 0);
 	rtcEnabled = ReadPref("rtcEnabled", 0);
 	saveDir = ReadPrefString("saveDir");
 	saveDotCodeFile = ReadPrefString("saveDotCodeFile");
@@ -493,6 +525,7 @@ void LoadConfig()
 	soundFiltering = (float)ReadPref("gbaSoundFiltering", 50) / 100.0f;
 	soundInterpolation = ReadPref("gbaSoundInterpolation", 1);
 	soundRecordDir = ReadPrefString("soundRecordDir");
+	soundThread = ReadPref("soundThread", 0);
 	threadPriority = ReadPref("priority", 2);
 	throttle = ReadPref("throttle", 100);
 	tripleBuffering = ReadPref("tripleBuffering", 0);
@@ -967,6 +1000,14 @@ int ReadOpts(int argc, char ** argv)
 			else
 				openGL = 0;
 			break;
+		case 'T':
+			// --throttle
+			if (optarg) {
+				throttle = atoi(optarg);
+				if (throttle < 5 || throttle > 1000)
+					throttle = 100;
+			}
+			break;
 
 		case OPT_CAPTURE_FORMAT:
 			// --capture-format
@@ -1108,6 +1149,25 @@ int ReadOpts(int argc, char ** argv)
 			}
 			break;
 
+		case OPT_RUN_AHEAD:
+			// --run-ahead
+			if (optarg) {
+				runAhead = atoi(optarg);
+			}
+			break;
+
+		case OPT_ROM_CACHE_DIR:
+			// --rom-cache-dir
+			romCacheDir = optarg;
+			break;
+
+		case OPT_ROM_CACHE_SIZE:
+			// --rom-cache-size
+			if (optarg) {
+				romCacheSize = atoi(optarg);
+			}
+			break;
+
 		case OPT_JOYPAD_DEFAULT:
 			// --joypad-default
 			if (optarg) {
@@ -1184,6 +1244,11 @@ int ReadOpts(int argc, char ** argv)
 			aviRecordDir = optarg;
 			break;
 
+		case OPT_MOVIE_PLAY:
+			// --movie-play
+			moviePlayFile = optarg;
+			break;
+
 		case OPT_MOVIE_RECORD_DIR:
 			// --movie-record-dir
 			movieRecordDir = optarg;
@@ -1209,6 +1274,13 @@ int ReadOpts(int argc, char ** argv)
 			batteryDir = optarg;
 			break;
 
+		case OPT_BENCHMARK:
+			// --benchmark
+			if (optarg) {
+				benchmarkFrames = atoi(optarg);
+			}
+			break;
+
 		case OPT_ROM_DIR_GBC:
 			// --rom-dir-gbc
 			romDirGBC = optarg;
@@ -16,7 +16,7 @@
 
 #define MAX_CHEATS 16384
 
-extern bool cpuIsMultiBoot;
+extern THREAD_STATE bool cpuIsMultiBoot;
 extern bool mirroringEnable;
 extern bool parseDebug;
 extern bool speedHack;
@@ -29,7 +29,9 @@ extern const char *biosFileNameGBC;
 extern const char *loadDotCodeFile;
 extern const char *saveDotCodeFile;
 extern const char *linkHostAddr;
+extern const char *moviePlayFile;
 extern const char *movieRecordDir;
+extern const char *romCacheDir;
 extern const char *romDirGB;
 extern const char *romDirGBA;
 extern const char *romDirGBC;
@@ -45,14 +47,16 @@ extern int autoLoadMostRecent;
 extern int autoPatch;
 extern int autoSaveLoadCheatList;
 extern int aviRecording;
+extern int benchmarkFrames;
 extern int captureFormat;
 extern int cheatsEnabled;
 extern int cpuDisableSfx;
-extern int cpuSaveType;
+extern THREAD_STATE int cpuSaveType;
 extern int dinputKeyFocus;
 extern int disableMMX;
 extern int disableStatusMessages;
 extern int dsoundDisableHardwareAcceleration;
+extern int fastForwardAudio;
 extern int filterHeight;
 extern int filterMagnification;
 extern int filterMT; // enable multi-threading for pixel filters
@@ -74,18 +78,15 @@ extern int glFilter;
 extern int ifbType;
 extern int joypadDefault;
 extern int languageOption;
-extern int layerEnable;
-extern int layerSettings;
+extern THREAD_STATE int layerEnable;
+extern THREAD_STATE int layerSettings;
 extern int linkAuto;
 extern int linkHacks;
 extern int linkMode;
 extern int linkNumPlayers;
 extern int linkTimeout;
 extern int maxScale;
-extern int movieFrame;
-extern int moviePlayFrame;
-extern int moviePlaying;
-extern int movieRecording;
+extern int mmapBattery;
 extern int openGL;
 extern int autoPatch;
 extern int optFlashSize;
@@ -101,8 +102,13 @@ extern int rewindSaveNeeded;
 extern int rewindTimer;
 extern int rewindTopPos;
 // extern int romSize;
-extern int rtcEnabled;
-extern int saveType;
+extern int pollKeyInput;
+extern int presentThread;
+extern int romCacheSize;
+extern int romPaging;
+extern THREAD_STATE int rtcEnabled;
+extern int runAhead;
+extern THREAD_STATE int saveType;
 extern int screenMessage;
 extern int sensorX;
 extern int sensorY;
@@ -115,13 +121,14 @@ extern int skipBios;
 extern int skipSaveGameBattery;
 extern int skipSaveGameCheats;
 extern int soundRecording;
+extern int soundThread;
 extern int speedupToggle;
 extern int sunBars;
 extern int surfaceSizeX;
 extern int surfaceSizeY;
 extern int threadPriority;
 extern int tripleBuffering;
-extern int useBios;
+extern THREAD_STATE int useBios;
 extern int useBiosFileGB;
 extern int useBiosFileGBA;
 extern int useBiosFileGBC;
@@ -135,8 +142,6 @@ extern int winGbBorderOn;
 extern int winGbPrinterEnabled;
 extern int winPauseNextFrame;
 extern uint32_t autoFrameSkipLastTime;
-extern uint32_t movieLastJoypad;
-extern uint32_t movieNextJoypad;
 extern int throttle;
 
 extern int preparedCheats;
@@ -0,0 +1,116 @@
+// VisualBoyAdvance - Nintendo Gameboy/GameboyAdvance (TM) emulator.
+// Copyright (C) 2015 VBA-M development team
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or(at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#include <string.h>
+#include <time.h>
+#ifdef _WIN32
+#include <SDL/SDL.h>
+#endif
+
+#include "FramePacer.h"
+
+// Left to spin after the sleep, more than the kernel usually oversleeps
+static const uint64_t SPIN_NS = 250000;
+
+FramePacer::FramePacer()
+{
+	reset(60);
+}
+
+void FramePacer::reset(double fps)
+{
+	_period = (uint64_t)(1e9 / fps);
+	_next = 0;
+	_last = 0;
+	_late = false;
+	_frames = 0;
+	memset(_histogram, 0, sizeof _histogram);
+}
+
+uint64_t FramePacer::now()
+{
+#ifndef _WIN32
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#else
+	return (uint64_t)SDL_GetTicks() * 1000000;
+#endif
+}
+
+void FramePacer::wait()
+{
+	uint64_t time = now();
+
+	_next += _period;
+	_late = time > _next;
+	if (time > _next + _period) {
+		_next = time;
+		record(time);
+		return;
+	}
+
+	if (_next > time + SPIN_NS) {
+#ifndef _WIN32
+		struct timespec ts;
+		uint64_t until = _next - SPIN_NS;
+		ts.tv_sec = until / 1000000000;
+		ts.tv_nsec = until % 1000000000;
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0)
+			; // interrupted by a signal
+#else
+		SDL_Delay((uint32_t)((_next - time - SPIN_NS) / 1000000));
+#endif
+	}
+
+	while ((time = now()) < _next)
+		;
+
+	record(time);
+}
+
+void FramePacer::tick()
+{
+	uint64_t time = now();
+
+	_next = time;
+	_late = false;
+	record(time);
+}
+
+void FramePacer::record(uint64_t time)
+{
+	if (_last) {
+		uint64_t bin = (time - _last) / (BIN_US * 1000);
+		_histogram[bin < BINS ? bin : BINS - 1]++;
+		_frames++;
+	}
+	_last = time;
+}
+
+unsigned FramePacer::percentile(double p) const
+{
+	unsigned target = (unsigned)(_frames * p / 100);
+	unsigned seen = 0;
+
+	for (int i = 0; i < BINS; i++) {
+		seen += _histogram[i];
+		if (seen >= target && seen)
+			return i * BIN_US;
+	}
+	return 0;
+}
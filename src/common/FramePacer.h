@@ -0,0 +1,70 @@
+// VisualBoyAdvance - Nintendo Gameboy/GameboyAdvance (TM) emulator.
+// Copyright (C) 2015 VBA-M development team
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or(at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#ifndef __VBA_FRAME_PACER_H__
+#define __VBA_FRAME_PACER_H__
+
+#include <stdint.h>
+
+/**
+ * Holds the emulator to a fixed frame rate on a high resolution clock,
+ * for when nothing else (a blocking sound driver) does. wait() sleeps
+ * most of the way to the next frame's deadline and spins the rest, so a
+ * frame is not late by whatever the scheduler rounds the sleep up to.
+ * It also keeps a histogram of the time between frames, paced or not.
+ */
+class FramePacer
+{
+public:
+	FramePacer();
+
+	// Starts over at fps frames per second, dropping the statistics
+	void reset(double fps);
+
+	// Sleeps until the next frame is due, then counts one. A frame more
+	// than a whole period late moves the deadlines instead of having the
+	// following frames catch up.
+	void wait();
+	// Counts one without pacing it
+	void tick();
+
+	// The last frame came after its deadline
+	bool late() const { return _late; }
+	// Nanoseconds per frame
+	uint64_t period() const { return _period; }
+
+	unsigned frames() const { return _frames; }
+	// Time between frames in microseconds that p percent of them were
+	// within, 0 <= p <= 100
+	unsigned percentile(double p) const;
+
+private:
+	// 10 us steps up to 100 ms, the last one holds anything longer
+	enum { BIN_US = 10, BINS = 10001 };
+
+	uint64_t _period;
+	uint64_t _next;
+	uint64_t _last;
+	bool _late;
+	unsigned _frames;
+	unsigned _histogram[BINS];
+
+	static uint64_t now();
+	void record(uint64_t time);
+};
+
+#endif // __VBA_FRAME_PACER_H__
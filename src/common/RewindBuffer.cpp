@@ -0,0 +1,244 @@
+// VisualBoyAdvance - Nintendo Gameboy/GameboyAdvance (TM) emulator.
+// Copyright (C) 2015 VBA-M development team
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or(at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "RewindBuffer.h"
+
+// Room for one uncompressed state
+static const size_t STATE_BUFFER_SIZE = 1 << 20;
+static const size_t STATE_BUFFER_WORDS = STATE_BUFFER_SIZE / 4;
+// 9 minutes of history at one snapshot per frame
+static const int ENTRY_MAX = 1 << 15;
+
+// Pads a state out to whole words; the padding must XOR to zero
+static size_t stateWords(char *state, long size)
+{
+	size_t words = ((size_t)size + 3) / 4;
+
+	if (size <= 0 || words > STATE_BUFFER_WORDS)
+		return 0;
+
+	memset(state + size, 0, words * 4 - size);
+	return words;
+}
+
+// Writes a ^ b as pairs of (equal words to skip, words that follow),
+// never more than words + 2 values
+static size_t encodeDelta(const uint32_t *a, const uint32_t *b, size_t words, uint32_t *out)
+{
+	uint32_t *o = out;
+	size_t i = 0;
+
+	while (i < words) {
+		uint32_t *token = o;
+		size_t start = i;
+
+		while (i < words && a[i] == b[i])
+			i++;
+		token[0] = (uint32_t)(i - start);
+		o += 2;
+
+		// a lone equal word is cheaper to copy than to skip, the last one
+		// too, so every skip but the first saves at least its token
+		start = i;
+		while (i < words && (a[i] != b[i] || i + 1 == words || a[i + 1] != b[i + 1])) {
+			*o++ = a[i] ^ b[i];
+			i++;
+		}
+		token[1] = (uint32_t)(i - start);
+	}
+
+	return o - out;
+}
+
+static void applyDelta(uint32_t *state, const uint32_t *delta, size_t words)
+{
+	const uint32_t *end = delta + words;
+
+	while (delta < end) {
+		uint32_t n = delta[1];
+
+		state += delta[0];
+		delta += 2;
+		while (n--)
+			*state++ ^= *delta++;
+	}
+}
+
+RewindBuffer::RewindBuffer():
+	_arena(NULL),
+	_arenaWords(0),
+	_top(0),
+	_entries(NULL),
+	_first(0),
+	_count(0),
+	_state(NULL),
+	_next(NULL),
+	_stateWords(0),
+	_delta(NULL)
+{
+}
+
+RewindBuffer::~RewindBuffer()
+{
+	freeBuffers();
+}
+
+void RewindBuffer::freeBuffers()
+{
+	free(_entries);
+	free(_state);
+	free(_next);
+	free(_delta);
+	_entries = NULL;
+	_state = NULL;
+	_next = NULL;
+	_delta = NULL;
+	_arena = NULL;
+	_arenaWords = 0;
+	clear();
+}
+
+bool RewindBuffer::reset(char *arena, size_t size)
+{
+	freeBuffers();
+
+	if (!arena)
+		return true;
+
+	_entries = (Entry *)malloc(ENTRY_MAX * sizeof(Entry));
+	_state = (char *)malloc(STATE_BUFFER_SIZE);
+	_next = (char *)malloc(STATE_BUFFER_SIZE);
+	_delta = (uint32_t *)malloc((STATE_BUFFER_WORDS + 2) * sizeof(uint32_t));
+
+	if (!_entries || !_state || !_next || !_delta) {
+		systemMessage(0, "Failed to allocate rewind buffers");
+		freeBuffers();
+		return false;
+	}
+
+	_arena = (uint32_t *)arena;
+	_arenaWords = size / 4;
+	return true;
+}
+
+void RewindBuffer::clear()
+{
+	_top = 0;
+	_first = 0;
+	_count = 0;
+	_stateWords = 0;
+}
+
+void RewindBuffer::dropOldest()
+{
+	_first = (_first + 1) % ENTRY_MAX;
+	if (--_count == 0)
+		_top = 0;
+}
+
+// Finds room for a delta above the newest one, dropping the oldest
+// until it fits
+size_t RewindBuffer::allocate(size_t words)
+{
+	if (_count == ENTRY_MAX)
+		dropOldest();
+
+	while (_count) {
+		size_t oldest = _entries[_first].offset;
+
+		if (oldest < _top) {
+			// free space is above the newest and below the oldest
+			if (_top + words <= _arenaWords)
+				break;
+			if (words <= oldest) {
+				_top = 0;
+				break;
+			}
+		} else if (_top + words <= oldest) {
+			// wrapped around, free space is between them
+			break;
+		}
+
+		dropOldest();
+	}
+
+	size_t pos = _top;
+	int last = (_first + _count) % ENTRY_MAX;
+
+	_entries[last].offset = pos;
+	_entries[last].words = words;
+	_count++;
+	_top = pos + words;
+
+	return pos;
+}
+
+bool RewindBuffer::capture(const EmulatedSystem &emu)
+{
+	long reserved = 0;
+
+	if (!_arena || !emu.emuWriteMemState)
+		return false;
+
+	if (!emu.emuWriteMemState(_next, STATE_BUFFER_SIZE, reserved))
+		return false;
+
+	size_t words = stateWords(_next, reserved);
+	if (!words)
+		return false;
+
+	if (words != _stateWords) {
+		// first snapshot, or a different game
+		clear();
+	} else {
+		// the old state is kept as its difference to the new one
+		size_t n = encodeDelta((uint32_t *)_state, (uint32_t *)_next, words, _delta);
+
+		if (n <= _arenaWords)
+			memcpy(_arena + allocate(n), _delta, n * sizeof(uint32_t));
+		else
+			clear();
+	}
+
+	char *tmp = _state;
+	_state = _next;
+	_next = tmp;
+	_stateWords = words;
+
+	return true;
+}
+
+bool RewindBuffer::stepBack(const EmulatedSystem &emu)
+{
+	if (!_stateWords || !emu.emuReadMemState)
+		return false;
+
+	if (_count) {
+		int newest = (_first + _count - 1) % ENTRY_MAX;
+		const Entry &e = _entries[newest];
+
+		applyDelta((uint32_t *)_state, _arena + e.offset, e.words);
+		_top = e.offset;
+		if (--_count == 0)
+			_top = 0;
+	}
+
+	return emu.emuReadMemState(_state, (int)(_stateWords * 4));
+}
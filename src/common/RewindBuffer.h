@@ -0,0 +1,75 @@
+// VisualBoyAdvance - Nintendo Gameboy/GameboyAdvance (TM) emulator.
+// Copyright (C) 2015 VBA-M development team
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or(at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#ifndef __VBA_REWIND_BUFFER_H__
+#define __VBA_REWIND_BUFFER_H__
+
+#include <stddef.h>
+
+#include "../System.h"
+
+/**
+ * History of emulator states for rewinding.
+ * Only the newest snapshot is kept whole. Every older one is stored as
+ * the XOR against its successor, with runs of zero words squeezed out,
+ * in a ring over a caller supplied arena; the oldest deltas are dropped
+ * when it fills up. Consecutive frames differ in a few KB, so a few MB
+ * hold minutes of history.
+ */
+class RewindBuffer
+{
+public:
+	RewindBuffer();
+	~RewindBuffer();
+
+	// arena must stay valid until reset(NULL, 0) or destruction
+	bool reset(char *arena, size_t size);
+	void clear();
+
+	bool capture(const EmulatedSystem &emu);
+	// Restores the snapshot before the newest one, or the newest one if
+	// there is no older history left
+	bool stepBack(const EmulatedSystem &emu);
+
+	int count() const { return _count; }
+
+private:
+	struct Entry {
+		size_t offset; // in words
+		size_t words;
+	};
+
+	uint32_t *_arena;
+	size_t _arenaWords;
+	size_t _top;
+
+	Entry *_entries;
+	int _first;
+	int _count;
+
+	// newest state, and the buffer the next one is written to
+	char *_state;
+	char *_next;
+	size_t _stateWords;
+	uint32_t *_delta;
+
+	void freeBuffers();
+	void dropOldest();
+	size_t allocate(size_t words);
+};
+
+#endif // __VBA_REWIND_BUFFER_H__
@@ -0,0 +1,198 @@
+// VisualBoyAdvance - Nintendo Gameboy/GameboyAdvance (TM) emulator.
+// Copyright (C) 2015 VBA-M development team
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or(at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "SoundRecorder.h"
+#include "Port.h"
+
+// 2^20 samples, a bit under 12 seconds of 44.1 kHz stereo
+static const size_t QUEUE_SAMPLES = 1 << 20;
+// stdio buffer, so the disk sees few large writes
+static const size_t FILE_BUFFER_SIZE = 1 << 20;
+// samples moved from the queue per fwrite
+static const size_t CHUNK_SAMPLES = 1 << 14;
+
+static const int WAV_HEADER_SIZE = 44;
+
+SoundRecorder::SoundRecorder():
+	_file(NULL),
+	_fileBuffer(NULL),
+	_dataBytes(0),
+	_thread(NULL),
+	_semData(NULL),
+	_semSpace(NULL),
+	_quit(false)
+{
+}
+
+SoundRecorder::~SoundRecorder()
+{
+	stop();
+}
+
+void SoundRecorder::writeHeader(long sampleRate)
+{
+	uint8_t header[WAV_HEADER_SIZE];
+
+	memcpy(&header[0], "RIFF", 4);
+	WRITE32LE(&header[4], 0); // patched by finishHeader()
+	memcpy(&header[8], "WAVE", 4);
+	memcpy(&header[12], "fmt ", 4);
+	WRITE32LE(&header[16], 16);
+	WRITE16LE(&header[20], 1); // PCM
+	WRITE16LE(&header[22], 2); // stereo
+	WRITE32LE(&header[24], (uint32_t)sampleRate);
+	WRITE32LE(&header[28], (uint32_t)sampleRate * 4);
+	WRITE16LE(&header[32], 4);
+	WRITE16LE(&header[34], 16);
+	memcpy(&header[36], "data", 4);
+	WRITE32LE(&header[40], 0); // patched by finishHeader()
+
+	fwrite(header, 1, sizeof header, _file);
+}
+
+void SoundRecorder::finishHeader()
+{
+	uint8_t size[4];
+
+	fflush(_file);
+
+	WRITE32LE(size, _dataBytes + WAV_HEADER_SIZE - 8);
+	fseek(_file, 4, SEEK_SET);
+	fwrite(size, 1, 4, _file);
+
+	WRITE32LE(size, _dataBytes);
+	fseek(_file, 40, SEEK_SET);
+	fwrite(size, 1, 4, _file);
+}
+
+bool SoundRecorder::start(const char *fileName, long sampleRate)
+{
+	stop();
+
+	_file = fopen(fileName, "wb");
+	if (!_file) {
+		systemMessage(0, "Error creating file %s", fileName);
+		return false;
+	}
+
+	_fileBuffer = (char *)malloc(FILE_BUFFER_SIZE);
+	if (_fileBuffer)
+		setvbuf(_file, _fileBuffer, _IOFBF, FILE_BUFFER_SIZE);
+
+	_dataBytes = 0;
+	writeHeader(sampleRate);
+
+	_queue.reset(QUEUE_SAMPLES);
+	_semData = SDL_CreateSemaphore(0);
+	_semSpace = SDL_CreateSemaphore(0);
+	_quit = false;
+
+	_thread = SDL_CreateThread(threadMain, this);
+	if (!_thread) {
+		systemMessage(0, "Failed to start sound recorder thread: %s", SDL_GetError());
+		_quit = true;
+		stop();
+		return false;
+	}
+
+	return true;
+}
+
+void SoundRecorder::stop()
+{
+	if (!_file)
+		return;
+
+	if (_thread) {
+		_quit = true;
+		SDL_SemPost(_semData);
+		SDL_WaitThread(_thread, NULL);
+		_thread = NULL;
+	}
+
+	finishHeader();
+	fclose(_file);
+	_file = NULL;
+
+	free(_fileBuffer);
+	_fileBuffer = NULL;
+
+	SDL_DestroySemaphore(_semData);
+	SDL_DestroySemaphore(_semSpace);
+	_semData = NULL;
+	_semSpace = NULL;
+
+	_queue.reset(0);
+}
+
+void SoundRecorder::write(const uint16_t *finalWave, int length)
+{
+	if (!_thread)
+		return;
+
+	size_t samples = length / sizeof *finalWave;
+
+	while (samples) {
+		size_t n = _queue.write(finalWave, samples);
+		finalWave += n;
+		samples -= n;
+
+		if (SDL_SemValue(_semData) == 0)
+			SDL_SemPost(_semData);
+
+		// Only when the disk can't keep up; dropping samples would
+		// desync the recording, so wait for room instead
+		if (samples)
+			SDL_SemWaitTimeout(_semSpace, 10);
+	}
+}
+
+void SoundRecorder::drain()
+{
+	uint16_t chunk[CHUNK_SAMPLES];
+	size_t n;
+
+	while ((n = _queue.read(chunk, CHUNK_SAMPLES)) != 0) {
+		if (SDL_SemValue(_semSpace) == 0)
+			SDL_SemPost(_semSpace);
+
+#ifdef WORDS_BIGENDIAN
+		for (size_t i = 0; i < n; i++)
+			chunk[i] = swap16(chunk[i]);
+#endif
+		fwrite(chunk, sizeof *chunk, n, _file);
+		_dataBytes += n * sizeof *chunk;
+	}
+}
+
+int SoundRecorder::threadMain(void *data)
+{
+	SoundRecorder *recorder = reinterpret_cast<SoundRecorder *>(data);
+
+	while (!recorder->_quit) {
+		SDL_SemWaitTimeout(recorder->_semData, 100);
+		recorder->drain();
+	}
+
+	// Whatever was queued before stop() was called
+	recorder->drain();
+
+	return 0;
+}
@@ -0,0 +1,65 @@
+// VisualBoyAdvance - Nintendo Gameboy/GameboyAdvance (TM) emulator.
+// Copyright (C) 2015 VBA-M development team
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or(at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#ifndef __VBA_SOUND_RECORDER_H__
+#define __VBA_SOUND_RECORDER_H__
+
+#include <stdio.h>
+
+#include "spscqueue.h"
+#include "../System.h"
+
+#include <SDL/SDL.h>
+
+/**
+ * Streams the emulator's 16-bit stereo output to a WAV file.
+ * write() only copies into a lock-free queue; a background thread does
+ * the file I/O with large buffered writes, so recording never waits on
+ * the disk unless the queue (several seconds of audio) is full.
+ */
+class SoundRecorder
+{
+public:
+	SoundRecorder();
+	~SoundRecorder();
+
+	bool start(const char *fileName, long sampleRate);
+	void stop();
+	bool isRecording() const { return _file != NULL; }
+
+	// length is in bytes, as passed to systemOnWriteDataToSoundBuffer
+	void write(const uint16_t *finalWave, int length);
+
+private:
+	SpscQueue<uint16_t> _queue;
+
+	FILE *_file;
+	char *_fileBuffer;
+	uint32_t _dataBytes;
+
+	SDL_Thread *_thread;
+	SDL_sem *_semData;
+	SDL_sem *_semSpace;
+	volatile bool _quit;
+
+	static int threadMain(void *data);
+	void drain();
+	void writeHeader(long sampleRate);
+	void finishHeader();
+};
+
+#endif // __VBA_SOUND_RECORDER_H__
@@ -40,9 +40,17 @@ void SoundSDL::soundCallback(void *data, uint8_t *stream, int len)
 
 void SoundSDL::read(uint16_t * stream, int length)
 {
-	if (!_initialized || length <= 0 || !emulating)
+	if (!_initialized || length <= 0)
 		return;
 
+	if (!emulating)
+	{
+		// a writer on the sound thread may still be waiting for room
+		if (SDL_SemValue(_semBufferEmpty) == 0)
+			SDL_SemPost(_semBufferEmpty);
+		return;
+	}
+
 
 	/* since this is running in a different thread, speedup and
 	 * throttle can change at any time; save the value so locks
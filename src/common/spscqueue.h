@@ -0,0 +1,137 @@
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <cstddef>
+#include "array.h"
+
+// Bounded queue for exactly one producer thread and one consumer thread.
+// Neither side takes a lock; the read and write positions are published
+// with acquire/release ordering so an element is fully written before the
+// consumer can see it. Capacity is rounded up to a power of two.
+template <typename T> class SpscQueue
+{
+  public:
+  typedef T value_type;
+  typedef size_t size_type;
+
+  private:
+  Array<T> m_buffer;
+  size_type m_mask;
+  size_type m_pos_read, m_pos_write; // free running, wrap via m_mask
+
+  static size_type load(const size_type &pos)
+  {
+    return __atomic_load_n(&pos, __ATOMIC_ACQUIRE);
+  }
+
+  static void store(size_type &pos, size_type value)
+  {
+    __atomic_store_n(&pos, value, __ATOMIC_RELEASE);
+  }
+
+  public:
+  SpscQueue(size_type size = 0) : m_mask(0), m_pos_read(0), m_pos_write(0)
+  {
+    this->reset(size);
+  }
+
+  // Not thread safe, both sides must be idle
+  void reset(size_type size)
+  {
+    size_type capacity = size ? 1 : 0;
+    while (capacity < size)
+      capacity <<= 1;
+
+    this->m_buffer.reset(capacity);
+    this->m_mask = capacity ? capacity - 1 : 0;
+    this->m_pos_read = this->m_pos_write = 0;
+  }
+
+  size_type size() const
+  {
+    return(this->m_buffer.size() ? this->m_mask + 1 : 0);
+  }
+
+  size_type used() const
+  {
+    return(load(this->m_pos_write) - load(this->m_pos_read));
+  }
+
+  size_type avail() const
+  {
+    return(this->size() - this->used());
+  }
+
+  bool empty() const
+  {
+    return(this->used() == 0);
+  }
+
+  // Producer side
+
+  bool push(const T &value)
+  {
+    size_type pos = this->m_pos_write;
+    if (pos - load(this->m_pos_read) >= this->size())
+      return false;
+
+    this->m_buffer[pos & this->m_mask] = value;
+    store(this->m_pos_write, pos + 1);
+    return true;
+  }
+
+  // Pushes as many of count values as fit, returns number pushed
+  size_type write(const T *values, size_type count)
+  {
+    size_type pos = this->m_pos_write;
+    size_type room = this->size() - (pos - load(this->m_pos_read));
+    if (count > room)
+      count = room;
+
+    for (size_type i = 0; i < count; i++)
+      this->m_buffer[(pos + i) & this->m_mask] = values[i];
+    store(this->m_pos_write, pos + count);
+    return count;
+  }
+
+  // Consumer side
+
+  // Oldest element, only valid if !empty(). It stays in the queue, and
+  // so keeps the producer from reusing its slot, until pop() is called.
+  T &front()
+  {
+    return this->m_buffer[this->m_pos_read & this->m_mask];
+  }
+
+  void pop()
+  {
+    store(this->m_pos_read, this->m_pos_read + 1);
+  }
+
+  bool pop(T &value)
+  {
+    size_type pos = this->m_pos_read;
+    if (pos == load(this->m_pos_write))
+      return false;
+
+    value = this->m_buffer[pos & this->m_mask];
+    store(this->m_pos_read, pos + 1);
+    return true;
+  }
+
+  // Pops up to count values, returns number popped
+  size_type read(T *values, size_type count)
+  {
+    size_type pos = this->m_pos_read;
+    size_type used = load(this->m_pos_write) - pos;
+    if (count > used)
+      count = used;
+
+    for (size_type i = 0; i < count; i++)
+      values[i] = this->m_buffer[(pos + i) & this->m_mask];
+    store(this->m_pos_read, pos + count);
+    return count;
+  }
+};
+
+#endif
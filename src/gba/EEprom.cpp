@@ -4,20 +4,20 @@
 #include <memory.h>
 #include <string.h>
 
-extern int cpuDmaCount;
+extern THREAD_STATE int cpuDmaCount;
 
-int eepromMode = EEPROM_IDLE;
-int eepromByte = 0;
-int eepromBits = 0;
-int eepromAddress = 0;
+THREAD_STATE int eepromMode = EEPROM_IDLE;
+THREAD_STATE int eepromByte = 0;
+THREAD_STATE int eepromBits = 0;
+THREAD_STATE int eepromAddress = 0;
 
-uint8_t eepromData[0x2000];
+THREAD_STATE uint8_t eepromData[0x2000];
 
-uint8_t eepromBuffer[16];
-bool eepromInUse = false;
-int eepromSize = 512;
+THREAD_STATE uint8_t eepromBuffer[16];
+THREAD_STATE bool eepromInUse = false;
+THREAD_STATE int eepromSize = 512;
 
-variable_desc eepromSaveData[] = {
+THREAD_STATE_INIT variable_desc eepromSaveData[] = {
     { &eepromMode, sizeof(int) },
     { &eepromByte, sizeof(int) },
     { &eepromBits, sizeof(int) },
@@ -43,7 +43,6 @@ void eepromReset()
     eepromSize = 512;
 }
 
-#ifdef __LIBRETRO__
 void eepromSaveGame(uint8_t*& data)
 {
     utilWriteDataMem(data, eepromSaveData);
@@ -51,6 +50,11 @@ void eepromSaveGame(uint8_t*& data)
     utilWriteMem(data, eepromData, 0x2000);
 }
 
+unsigned eepromSaveGameSize()
+{
+    return utilDataSize(eepromSaveData) + sizeof(int) + 0x2000;
+}
+
 void eepromReadGame(const uint8_t*& data, int version)
 {
     utilReadDataMem(data, eepromSaveData);
@@ -63,8 +67,7 @@ void eepromReadGame(const uint8_t*& data, int version)
     }
 }
 
-#else // !__LIBRETRO__
-
+#ifndef __LIBRETRO__
 void eepromSaveGame(gzFile gzFile)
 {
     utilWriteData(gzFile, eepromSaveData);
@@ -2,22 +2,23 @@
 #define EEPROM_H
 
 #include "../common/Types.h"
+#include "../System.h"
 
-#ifdef __LIBRETRO__
 extern void eepromSaveGame(uint8_t*& data);
 extern void eepromReadGame(const uint8_t*& data, int version);
-#else // !__LIBRETRO__
+extern unsigned eepromSaveGameSize();
+#ifndef __LIBRETRO__
 extern void eepromSaveGame(gzFile _gzFile);
 extern void eepromReadGame(gzFile _gzFile, int version);
 extern void eepromReadGameSkip(gzFile _gzFile, int version);
 #endif
-extern uint8_t eepromData[0x2000];
+extern THREAD_STATE uint8_t eepromData[0x2000];
 extern int eepromRead(uint32_t address);
 extern void eepromWrite(uint32_t address, uint8_t value);
 extern void eepromInit();
 extern void eepromReset();
-extern bool eepromInUse;
-extern int eepromSize;
+extern THREAD_STATE bool eepromInUse;
+extern THREAD_STATE int eepromSize;
 
 #define EEPROM_IDLE 0
 #define EEPROM_READADDRESS 1
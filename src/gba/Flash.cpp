@@ -18,23 +18,23 @@
 #define FLASH_PROGRAM 8
 #define FLASH_SETBANK 9
 
-uint8_t flashSaveMemory[FLASH_128K_SZ];
+THREAD_STATE uint8_t flashSaveMemory[FLASH_128K_SZ];
 
-int flashState = FLASH_READ_ARRAY;
-int flashReadState = FLASH_READ_ARRAY;
-int flashSize = 0x10000;
-int flashDeviceID = 0x1b;
-int flashManufacturerID = 0x32;
-int flashBank = 0;
+THREAD_STATE int flashState = FLASH_READ_ARRAY;
+THREAD_STATE int flashReadState = FLASH_READ_ARRAY;
+THREAD_STATE int flashSize = 0x10000;
+THREAD_STATE int flashDeviceID = 0x1b;
+THREAD_STATE int flashManufacturerID = 0x32;
+THREAD_STATE int flashBank = 0;
 
-static variable_desc flashSaveData[] = {
+static THREAD_STATE_INIT variable_desc flashSaveData[] = {
     { &flashState, sizeof(int) },
     { &flashReadState, sizeof(int) },
     { &flashSaveMemory[0], 0x10000 },
     { NULL, 0 }
 };
 
-static variable_desc flashSaveData2[] = {
+static THREAD_STATE_INIT variable_desc flashSaveData2[] = {
     { &flashState, sizeof(int) },
     { &flashReadState, sizeof(int) },
     { &flashSize, sizeof(int) },
@@ -42,7 +42,7 @@ static variable_desc flashSaveData2[] = {
     { NULL, 0 }
 };
 
-static variable_desc flashSaveData3[] = {
+static THREAD_STATE_INIT variable_desc flashSaveData3[] = {
     { &flashState, sizeof(int) },
     { &flashReadState, sizeof(int) },
     { &flashSize, sizeof(int) },
@@ -63,18 +63,22 @@ void flashReset()
     flashBank = 0;
 }
 
-#ifdef __LIBRETRO__
 void flashSaveGame(uint8_t*& data)
 {
     utilWriteDataMem(data, flashSaveData3);
 }
 
+unsigned flashSaveGameSize()
+{
+    return utilDataSize(flashSaveData3);
+}
+
 void flashReadGame(const uint8_t*& data, int)
 {
     utilReadDataMem(data, flashSaveData3);
 }
 
-#else // !__LIBRETRO__
+#ifndef __LIBRETRO__
 void flashSaveGame(gzFile gzFile)
 {
     utilWriteData(gzFile, flashSaveData3);
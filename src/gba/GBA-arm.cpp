@@ -27,7 +27,7 @@
 
 ///////////////////////////////////////////////////////////////////////////
 
-static int clockTicks;
+static THREAD_STATE int clockTicks;
 
 static INSN_REGPARM void armUnknownInsn(uint32_t opcode)
 {
@@ -34,7 +34,7 @@
 
 ///////////////////////////////////////////////////////////////////////////
 
-static int clockTicks;
+static THREAD_STATE int clockTicks;
 
 static INSN_REGPARM void thumbUnknownInsn(uint32_t opcode)
 {
@@ -4,9 +4,20 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #ifndef _MSC_VER
 #include <strings.h>
 #endif
+#if !defined(__LIBRETRO__) && !defined(_WIN32)
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+#include <zlib.h>
+#endif
 #include "../NLS.h"
 #include "../System.h"
 #include "../Util.h"
@@ -20,6 +31,7 @@
 #include "GBAcpu.h"
 #include "GBAinline.h"
 #include "Globals.h"
+#include "Movie.h"
 #include "Sound.h"
 #include "Sram.h"
 #include "agbprint.h"
@@ -36,38 +48,48 @@
 #endif
 
 extern int emulating;
-bool debugger;
-
-int SWITicks = 0;
-int IRQTicks = 0;
-
-uint32_t mastercode = 0;
-int layerEnableDelay = 0;
-bool busPrefetch = false;
-bool busPrefetchEnable = false;
-uint32_t busPrefetchCount = 0;
-int cpuDmaTicksToUpdate = 0;
-int cpuDmaCount = 0;
-bool cpuDmaHack = false;
-uint32_t cpuDmaLast = 0;
-int dummyAddress = 0;
-
-bool cpuBreakLoop = false;
-int cpuNextEvent = 0;
-
-int gbaSaveType = 0; // used to remember the save type on reset
-bool intState = false;
-bool stopState = false;
-bool holdState = false;
-int holdType = 0;
-bool cpuSramEnabled = true;
-bool cpuFlashEnabled = true;
-bool cpuEEPROMEnabled = true;
-bool cpuEEPROMSensorEnabled = false;
-
-uint32_t cpuPrefetch[2];
-
-int cpuTotalTicks = 0;
+THREAD_STATE bool debugger;
+
+THREAD_STATE int SWITicks = 0;
+THREAD_STATE int IRQTicks = 0;
+
+THREAD_STATE uint32_t mastercode = 0;
+THREAD_STATE int layerEnableDelay = 0;
+THREAD_STATE bool busPrefetch = false;
+THREAD_STATE bool busPrefetchEnable = false;
+THREAD_STATE uint32_t busPrefetchCount = 0;
+THREAD_STATE int cpuDmaTicksToUpdate = 0;
+THREAD_STATE int cpuDmaCount = 0;
+THREAD_STATE bool cpuDmaHack = false;
+THREAD_STATE uint32_t cpuDmaLast = 0;
+THREAD_STATE int dummyAddress = 0;
+
+THREAD_STATE bool cpuBreakLoop = false;
+THREAD_STATE int cpuNextEvent = 0;
+
+THREAD_STATE int gbaSaveType = 0; // used to remember the save type on reset
+THREAD_STATE bool intState = false;
+THREAD_STATE bool stopState = false;
+THREAD_STATE bool holdState = false;
+THREAD_STATE int holdType = 0;
+THREAD_STATE bool cpuSramEnabled = true;
+THREAD_STATE bool cpuFlashEnabled = true;
+THREAD_STATE bool cpuEEPROMEnabled = true;
+THREAD_STATE bool cpuEEPROMSensorEnabled = false;
+THREAD_STATE bool cpuRenderEnabled = true; // false for frames nobody will see (run-ahead)
+bool cpuRomMapEnabled = true;
+THREAD_STATE bool cpuKeyInputPolling = false;
+THREAD_STATE int cpuSpeedupFrameSkip = 9; // frames skipped per one drawn during speedup
+const char* cpuRomPagingDir = NULL;
+const char* cpuRomCacheDir = NULL;
+uint64_t cpuRomCacheSize = 0;
+THREAD_STATE bool cpuTimingEnabled = false;
+THREAD_STATE uint64_t cpuTiming[TIMING_COUNT];
+THREAD_STATE uint32_t cpuRomOpenBus = ROM_SIZE;
+
+THREAD_STATE uint32_t cpuPrefetch[2];
+
+THREAD_STATE int cpuTotalTicks = 0;
 #ifdef PROFILING
 int profilingTicks = 0;
 int profilingTicksReload = 0;
@@ -75,59 +97,59 @@ static profile_segment* profilSegment = NULL;
 #endif
 
 #ifdef BKPT_SUPPORT
-uint8_t freezeWorkRAM[WORK_RAM_SIZE];
-uint8_t freezeInternalRAM[0x8000];
-uint8_t freezeVRAM[0x18000];
-uint8_t freezePRAM[0x400];
-uint8_t freezeOAM[0x400];
-bool debugger_last;
+THREAD_STATE uint8_t freezeWorkRAM[WORK_RAM_SIZE];
+THREAD_STATE uint8_t freezeInternalRAM[0x8000];
+THREAD_STATE uint8_t freezeVRAM[0x18000];
+THREAD_STATE uint8_t freezePRAM[0x400];
+THREAD_STATE uint8_t freezeOAM[0x400];
+THREAD_STATE bool debugger_last;
 #endif
 
-int lcdTicks = (useBios && !skipBios) ? 1008 : 208;
-uint8_t timerOnOffDelay = 0;
-uint16_t timer0Value = 0;
-bool timer0On = false;
-int timer0Ticks = 0;
-int timer0Reload = 0;
-int timer0ClockReload = 0;
-uint16_t timer1Value = 0;
-bool timer1On = false;
-int timer1Ticks = 0;
-int timer1Reload = 0;
-int timer1ClockReload = 0;
-uint16_t timer2Value = 0;
-bool timer2On = false;
-int timer2Ticks = 0;
-int timer2Reload = 0;
-int timer2ClockReload = 0;
-uint16_t timer3Value = 0;
-bool timer3On = false;
-int timer3Ticks = 0;
-int timer3Reload = 0;
-int timer3ClockReload = 0;
-uint32_t dma0Source = 0;
-uint32_t dma0Dest = 0;
-uint32_t dma1Source = 0;
-uint32_t dma1Dest = 0;
-uint32_t dma2Source = 0;
-uint32_t dma2Dest = 0;
-uint32_t dma3Source = 0;
-uint32_t dma3Dest = 0;
-void (*cpuSaveGameFunc)(uint32_t, uint8_t) = flashSaveDecide;
-void (*renderLine)() = mode0RenderLine;
-bool fxOn = false;
-bool windowOn = false;
-int frameCount = 0;
-char buffer[1024];
-uint32_t lastTime = 0;
-int count = 0;
-
-int capture = 0;
-int capturePrevious = 0;
-int captureNumber = 0;
-
-int armOpcodeCount = 0;
-int thumbOpcodeCount = 0;
+THREAD_STATE int lcdTicks = 208;
+THREAD_STATE uint8_t timerOnOffDelay = 0;
+THREAD_STATE uint16_t timer0Value = 0;
+THREAD_STATE bool timer0On = false;
+THREAD_STATE int timer0Ticks = 0;
+THREAD_STATE int timer0Reload = 0;
+THREAD_STATE int timer0ClockReload = 0;
+THREAD_STATE uint16_t timer1Value = 0;
+THREAD_STATE bool timer1On = false;
+THREAD_STATE int timer1Ticks = 0;
+THREAD_STATE int timer1Reload = 0;
+THREAD_STATE int timer1ClockReload = 0;
+THREAD_STATE uint16_t timer2Value = 0;
+THREAD_STATE bool timer2On = false;
+THREAD_STATE int timer2Ticks = 0;
+THREAD_STATE int timer2Reload = 0;
+THREAD_STATE int timer2ClockReload = 0;
+THREAD_STATE uint16_t timer3Value = 0;
+THREAD_STATE bool timer3On = false;
+THREAD_STATE int timer3Ticks = 0;
+THREAD_STATE int timer3Reload = 0;
+THREAD_STATE int timer3ClockReload = 0;
+THREAD_STATE uint32_t dma0Source = 0;
+THREAD_STATE uint32_t dma0Dest = 0;
+THREAD_STATE uint32_t dma1Source = 0;
+THREAD_STATE uint32_t dma1Dest = 0;
+THREAD_STATE uint32_t dma2Source = 0;
+THREAD_STATE uint32_t dma2Dest = 0;
+THREAD_STATE uint32_t dma3Source = 0;
+THREAD_STATE uint32_t dma3Dest = 0;
+THREAD_STATE void (*cpuSaveGameFunc)(uint32_t, uint8_t) = flashSaveDecide;
+THREAD_STATE void (*renderLine)() = mode0RenderLine;
+THREAD_STATE bool fxOn = false;
+THREAD_STATE bool windowOn = false;
+THREAD_STATE int frameCount = 0;
+THREAD_STATE char buffer[1024];
+THREAD_STATE uint32_t lastTime = 0;
+THREAD_STATE int count = 0;
+
+THREAD_STATE int capture = 0;
+THREAD_STATE int capturePrevious = 0;
+THREAD_STATE int captureNumber = 0;
+
+THREAD_STATE int armOpcodeCount = 0;
+THREAD_STATE int thumbOpcodeCount = 0;
 
 const int TIMER_TICKS[4] = {
     0,
@@ -145,10 +167,10 @@ const uint8_t gamepakWaitState2[2] = { 8, 1 };
 const bool isInRom[16] = { false, false, false, false, false, false, false, false,
     true, true, true, true, true, true, false, false };
 
-uint8_t memoryWait[16] = { 0, 0, 2, 0, 0, 0, 0, 0, 4, 4, 4, 4, 4, 4, 4, 0 };
-uint8_t memoryWait32[16] = { 0, 0, 5, 0, 0, 1, 1, 0, 7, 7, 9, 9, 13, 13, 4, 0 };
-uint8_t memoryWaitSeq[16] = { 0, 0, 2, 0, 0, 0, 0, 0, 2, 2, 4, 4, 8, 8, 4, 0 };
-uint8_t memoryWaitSeq32[16] = { 0, 0, 5, 0, 0, 1, 1, 0, 5, 5, 9, 9, 17, 17, 4, 0 };
+THREAD_STATE uint8_t memoryWait[16] = { 0, 0, 2, 0, 0, 0, 0, 0, 4, 4, 4, 4, 4, 4, 4, 0 };
+THREAD_STATE uint8_t memoryWait32[16] = { 0, 0, 5, 0, 0, 1, 1, 0, 7, 7, 9, 9, 13, 13, 4, 0 };
+THREAD_STATE uint8_t memoryWaitSeq[16] = { 0, 0, 2, 0, 0, 0, 0, 0, 2, 2, 4, 4, 8, 8, 4, 0 };
+THREAD_STATE uint8_t memoryWaitSeq32[16] = { 0, 0, 5, 0, 0, 1, 1, 0, 5, 5, 9, 9, 17, 17, 4, 0 };
 
 // The videoMemoryWait constants are used to add some waitstates
 // if the opcode access video memory data outside of vblank/hblank
@@ -157,7 +179,7 @@ uint8_t memoryWaitSeq32[16] = { 0, 0, 5, 0, 0, 1, 1, 0, 5, 5, 9, 9, 17, 17, 4, 0
 //const uint8_t videoMemoryWait[16] =
 //  {0, 0, 0, 0, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0};
 
-uint8_t biosProtected[4];
+THREAD_STATE uint8_t biosProtected[4];
 
 #ifdef WORDS_BIGENDIAN
 bool cpuBiosSwapped = false;
@@ -339,7 +361,7 @@ uint32_t myROM[] = {
     0x03007FE0
 };
 
-variable_desc saveGameStruct[] = {
+THREAD_STATE_INIT variable_desc saveGameStruct[] = {
     { &DISPCNT, sizeof(uint16_t) },
     { &DISPSTAT, sizeof(uint16_t) },
     { &VCOUNT, sizeof(uint16_t) },
@@ -458,7 +480,22 @@ variable_desc saveGameStruct[] = {
     { NULL, 0 }
 };
 
-static int romSize = ROM_SIZE;
+static THREAD_STATE int romSize = ROM_SIZE;
+static THREAD_STATE bool romMirrored = false;
+#if !defined(__LIBRETRO__) && !defined(_WIN32)
+static THREAD_STATE bool romMapped = false;
+#endif
+
+// Where ROM reads stop seeing the image and get open bus instead
+static void CPUUpdateRomOpenBus()
+{
+    if (agbPrintIsEnabled())
+        cpuRomOpenBus = ROM_SIZE; // its buffers sit past the end of the image
+    else if (romMirrored)
+        cpuRomOpenBus = 0x1000000;
+    else
+        cpuRomOpenBus = (romSize + 1) & ~1;
+}
 
 #ifdef PROFILING
 void cpuProfil(profile_segment* seg)
@@ -547,10 +584,10 @@ void CPUUpdateWindow1()
     }
 }
 
-extern uint32_t line0[240];
-extern uint32_t line1[240];
-extern uint32_t line2[240];
-extern uint32_t line3[240];
+extern THREAD_STATE uint32_t line0[240];
+extern THREAD_STATE uint32_t line1[240];
+extern THREAD_STATE uint32_t line2[240];
+extern THREAD_STATE uint32_t line3[240];
 
 #define CLEAR_ARRAY(a)                  \
     {                                   \
@@ -577,12 +614,59 @@ void CPUUpdateRenderBuffers(bool force)
 }
 
 #ifdef __LIBRETRO__
-#include <stddef.h>
+#define STATE_PIX_SIZE (4 * 240 * 160)
+#else
+#define STATE_PIX_SIZE (2 * 240 * 160)
+#endif
 
-unsigned int CPUWriteState(uint8_t* data, unsigned size)
+void CPUMarkAllDirty()
 {
-    uint8_t* orig = data;
+    memset(dirtyInternalRAM, 1, sizeof(dirtyInternalRAM));
+    memset(dirtyWorkRAM, 1, sizeof(dirtyWorkRAM));
+    memset(dirtyVRAM, 1, sizeof(dirtyVRAM));
+}
+
+static void CPUClearDirty()
+{
+    memset(dirtyInternalRAM, 0, sizeof(dirtyInternalRAM));
+    memset(dirtyWorkRAM, 0, sizeof(dirtyWorkRAM));
+    memset(dirtyVRAM, 0, sizeof(dirtyVRAM));
+}
+
+// With dirtyOnly, only the pages flagged in dirty are copied; the others
+// are skipped over and keep what the buffer already holds
+static void CPUWritePagesMem(uint8_t*& data, const uint8_t* mem, const uint8_t* dirty, int size, bool dirtyOnly)
+{
+    if (!dirtyOnly) {
+        utilWriteMem(data, mem, size);
+        return;
+    }
+
+    for (int page = 0; page < (size >> DIRTY_PAGE_SHIFT); page++) {
+        if (dirty[page])
+            memcpy(data + (page << DIRTY_PAGE_SHIFT), mem + (page << DIRTY_PAGE_SHIFT), 1 << DIRTY_PAGE_SHIFT);
+    }
+    data += size;
+}
+
+static void CPUReadPagesMem(uint8_t* mem, const uint8_t* dirty, const uint8_t*& data, int size, bool dirtyOnly)
+{
+    if (!dirtyOnly) {
+        utilReadMem(mem, data, size);
+        return;
+    }
 
+    for (int page = 0; page < (size >> DIRTY_PAGE_SHIFT); page++) {
+        if (dirty[page])
+            memcpy(mem + (page << DIRTY_PAGE_SHIFT), data + (page << DIRTY_PAGE_SHIFT), 1 << DIRTY_PAGE_SHIFT);
+    }
+    data += size;
+}
+
+// Save game data copied straight to memory, in the order the gzip path
+// writes it. Only the current version is understood.
+static void CPUWriteStateMem(uint8_t*& data, bool dirtyOnly = false)
+{
     utilWriteIntMem(data, SAVE_GAME_VERSION);
     utilWriteMem(data, &rom[0xa0], 16);
     utilWriteIntMem(data, useBios);
@@ -593,28 +677,21 @@ unsigned int CPUWriteState(uint8_t* data, unsigned size)
     utilWriteIntMem(data, stopState);
     utilWriteIntMem(data, IRQTicks);
 
-    utilWriteMem(data, internalRAM, 0x8000);
+    CPUWritePagesMem(data, internalRAM, dirtyInternalRAM, 0x8000, dirtyOnly);
     utilWriteMem(data, paletteRAM, 0x400);
-    utilWriteMem(data, workRAM, WORK_RAM_SIZE);
-    utilWriteMem(data, vram, 0x20000);
+    CPUWritePagesMem(data, workRAM, dirtyWorkRAM, WORK_RAM_SIZE, dirtyOnly);
+    CPUWritePagesMem(data, vram, dirtyVRAM, 0x20000, dirtyOnly);
     utilWriteMem(data, oam, 0x400);
-    utilWriteMem(data, pix, 4 * 240 * 160);
+    utilWriteMem(data, pix, STATE_PIX_SIZE);
     utilWriteMem(data, ioMem, 0x400);
 
     eepromSaveGame(data);
     flashSaveGame(data);
     soundSaveGame(data);
     rtcSaveGame(data);
-
-    return (ptrdiff_t)data - (ptrdiff_t)orig;
 }
 
-bool CPUWriteMemState(char* memory, int available, long& reserved)
-{
-    return false;
-}
-
-bool CPUReadState(const uint8_t* data, unsigned size)
+static bool CPUReadStateMem(const uint8_t*& data, bool loadSound, bool dirtyOnly = false)
 {
     // Don't really care about version.
     int version = utilReadIntMem(data);
@@ -643,32 +720,39 @@ bool CPUReadState(const uint8_t* data, unsigned size)
         IRQTicks = 0;
     }
 
-    utilReadMem(internalRAM, data, 0x8000);
+    CPUReadPagesMem(internalRAM, dirtyInternalRAM, data, 0x8000, dirtyOnly);
     utilReadMem(paletteRAM, data, 0x400);
-    utilReadMem(workRAM, data, WORK_RAM_SIZE);
-    utilReadMem(vram, data, 0x20000);
+    CPUReadPagesMem(workRAM, dirtyWorkRAM, data, WORK_RAM_SIZE, dirtyOnly);
+    CPUReadPagesMem(vram, dirtyVRAM, data, 0x20000, dirtyOnly);
     utilReadMem(oam, data, 0x400);
-    utilReadMem(pix, data, 4 * 240 * 160);
+    utilReadMem(pix, data, STATE_PIX_SIZE);
     utilReadMem(ioMem, data, 0x400);
 
+    // Memory now matches the incremental base again, or nothing is known
+    if (dirtyOnly)
+        CPUClearDirty();
+    else
+        CPUMarkAllDirty();
+
     eepromReadGame(data, version);
     flashReadGame(data, version);
-    soundReadGame(data, version);
+    if (loadSound)
+        soundReadGame(data, version);
+    else
+        soundReadGameSkip(data, version);
     rtcReadGame(data);
 
-    //// Copypasta stuff ...
+    return true;
+}
+
+// Rebuilds everything derived from the registers after a state was read
+static void CPUStateLoaded()
+{
     // set pointers!
     layerEnable = layerSettings & DISPCNT;
 
     CPUUpdateRender();
-
-    // CPU Update Render Buffers set to true
-    CLEAR_ARRAY(line0);
-    CLEAR_ARRAY(line1);
-    CLEAR_ARRAY(line2);
-    CLEAR_ARRAY(line3);
-    // End of CPU Update Render Buffers set to true
-
+    CPUUpdateRenderBuffers(true);
     CPUUpdateWindow0();
     CPUUpdateWindow1();
     gbaSaveType = 0;
@@ -684,6 +768,127 @@ bool CPUReadState(const uint8_t* data, unsigned size)
     }
 
     CPUUpdateRegister(0x204, CPUReadHalfWordQuick(0x4000204));
+}
+
+// Raw states put a header in front of the memory layout above. Their
+// size is fixed for a build, so callers can allocate once and reuse.
+#define RAW_STATE_MAGIC 0x57415256 // "VRAW"
+#define RAW_STATE_HEADER_SIZE 16
+
+// Adds up what CPUWriteStateMem() writes, block by block, without
+// touching any of it: none of the memory needs to exist yet
+unsigned CPURawStateSize()
+{
+    return RAW_STATE_HEADER_SIZE
+        + sizeof(int) + 16 + sizeof(int) + sizeof(reg)
+        + utilDataSize(saveGameStruct)
+        + sizeof(int) + sizeof(int)
+        + 0x8000 + 0x400 + WORK_RAM_SIZE + 0x20000 + 0x400 + STATE_PIX_SIZE + 0x400
+        + eepromSaveGameSize()
+        + flashSaveGameSize()
+        + soundSaveGameSize()
+        + rtcSaveGameSize();
+}
+
+unsigned CPUWriteRawState(uint8_t* data, unsigned size)
+{
+    unsigned stateSize = CPURawStateSize();
+
+    if (!stateSize || size < stateSize)
+        return 0;
+
+    utilWriteIntMem(data, RAW_STATE_MAGIC);
+    utilWriteIntMem(data, SAVE_GAME_VERSION);
+    utilWriteIntMem(data, stateSize);
+    utilWriteIntMem(data, 0);
+
+    CPUWriteStateMem(data);
+
+    return stateSize;
+}
+
+static bool CPUReadRawStateMem(const uint8_t* data, unsigned size, bool loadSound, bool dirtyOnly)
+{
+    unsigned stateSize = CPURawStateSize();
+
+    if (!stateSize || size < stateSize)
+        return false;
+
+    if (utilReadIntMem(data) != RAW_STATE_MAGIC
+        || utilReadIntMem(data) != SAVE_GAME_VERSION
+        || (unsigned)utilReadIntMem(data) != stateSize)
+        return false;
+    utilReadIntMem(data);
+
+    if (!CPUReadStateMem(data, loadSound, dirtyOnly))
+        return false;
+
+    CPUStateLoaded();
+
+    return true;
+}
+
+bool CPUReadRawState(const uint8_t* data, unsigned size, bool loadSound)
+{
+    return CPUReadRawStateMem(data, size, loadSound, false);
+}
+
+// The buffer the dirty flags are relative to: it holds a raw state that
+// matches memory in every page not flagged
+static THREAD_STATE const uint8_t* dirtyBase = NULL;
+
+unsigned CPUWriteRawStateDirty(uint8_t* data, unsigned size)
+{
+    unsigned stateSize = CPURawStateSize();
+
+    if (!stateSize || size < stateSize)
+        return 0;
+
+    bool dirtyOnly = data == dirtyBase;
+    dirtyBase = data;
+
+    utilWriteIntMem(data, RAW_STATE_MAGIC);
+    utilWriteIntMem(data, SAVE_GAME_VERSION);
+    utilWriteIntMem(data, stateSize);
+    utilWriteIntMem(data, 0);
+
+    CPUWriteStateMem(data, dirtyOnly);
+    CPUClearDirty();
+
+    return stateSize;
+}
+
+bool CPUReadRawStateDirty(const uint8_t* data, unsigned size, bool loadSound)
+{
+    return CPUReadRawStateMem(data, size, loadSound, data == dirtyBase);
+}
+
+// The same bytes CPUWriteState(const char*) compresses, so a frontend
+// can capture a state now and leave the compression to another thread
+unsigned int CPUWriteState(uint8_t* data, unsigned size)
+{
+    uint8_t* orig = data;
+
+    if (size < CPURawStateSize() - RAW_STATE_HEADER_SIZE)
+        return 0;
+
+    CPUWriteStateMem(data);
+
+    return (unsigned)(data - orig);
+}
+
+#ifdef __LIBRETRO__
+bool CPUWriteMemState(char* memory, int available, long& reserved)
+{
+    return false;
+}
+
+bool CPUReadState(const uint8_t* data, unsigned size)
+{
+    if (!CPUReadStateMem(data, true))
+        return false;
+
+    CPUStateLoaded();
 
     return true;
 }
@@ -712,7 +917,7 @@ static bool CPUWriteState(gzFile gzFile)
     utilGzWrite(gzFile, workRAM, WORK_RAM_SIZE);
     utilGzWrite(gzFile, vram, 0x20000);
     utilGzWrite(gzFile, oam, 0x400);
-    utilGzWrite(gzFile, pix, 2 * 240 * 160);
+    utilGzWrite(gzFile, pix, STATE_PIX_SIZE);
     utilGzWrite(gzFile, ioMem, 0x400);
 
     eepromSaveGame(gzFile);
@@ -741,24 +946,12 @@ bool CPUWriteState(const char* file)
     return res;
 }
 
+// Memory states are only used for rewind, so they take the raw path
 bool CPUWriteMemState(char* memory, int available, long& reserved)
 {
-    gzFile gzFile = utilMemGzOpen(memory, available, "w");
+    reserved = CPUWriteRawState((uint8_t*)memory, available);
 
-    if (gzFile == NULL) {
-        return false;
-    }
-
-    bool res = CPUWriteState(gzFile);
-
-    reserved = utilGzMemTell(gzFile) + 8;
-
-    if (reserved >= (available))
-        res = false;
-
-    utilGzClose(gzFile);
-
-    return res;
+    return reserved != 0;
 }
 
 static bool CPUReadState(gzFile gzFile)
@@ -824,8 +1017,9 @@ static bool CPUReadState(gzFile gzFile)
     utilGzRead(gzFile, workRAM, WORK_RAM_SIZE);
     utilGzRead(gzFile, vram, 0x20000);
     utilGzRead(gzFile, oam, 0x400);
-    utilGzRead(gzFile, pix, 2 * 240 * 160);
+    utilGzRead(gzFile, pix, STATE_PIX_SIZE);
     utilGzRead(gzFile, ioMem, 0x400);
+    CPUMarkAllDirty();
 
     if (skipSaveGameBattery) {
         // skip eeprom data
@@ -873,39 +1067,14 @@ static bool CPUReadState(gzFile gzFile)
         interp_rate();
     }
 
-    // set pointers!
-    layerEnable = layerSettings & DISPCNT;
-
-    CPUUpdateRender();
-    CPUUpdateRenderBuffers(true);
-    CPUUpdateWindow0();
-    CPUUpdateWindow1();
-    gbaSaveType = 0;
-    SetSaveType(saveType);
-    if (eepromInUse)
-        gbaSaveType = 3;
-
-    systemSaveUpdateCounter = SYSTEM_SAVE_NOT_UPDATED;
-    if (armState) {
-        ARM_PREFETCH;
-    } else {
-        THUMB_PREFETCH;
-    }
-
-    CPUUpdateRegister(0x204, CPUReadHalfWordQuick(0x4000204));
+    CPUStateLoaded();
 
     return true;
 }
 
 bool CPUReadMemState(char* memory, int available)
 {
-    gzFile gzFile = utilMemGzOpen(memory, available, "r");
-
-    bool res = CPUReadState(gzFile);
-
-    utilGzClose(gzFile);
-
-    return res;
+    return CPUReadRawState((const uint8_t*)memory, available);
 }
 
 bool CPUReadState(const char* file)
@@ -948,7 +1117,8 @@ bool CPUExportEepromFile(const char* fileName)
     return true;
 }
 
-bool CPUWriteBatteryFile(const char* fileName)
+// What goes in the .sav file, NULL if the game saves nothing
+static const uint8_t* CPUBatteryData(size_t& size)
 {
     if (gbaSaveType == 0) {
         if (eepromInUse)
@@ -964,7 +1134,29 @@ bool CPUWriteBatteryFile(const char* fileName)
             }
     }
 
-    if ((gbaSaveType) && (gbaSaveType != 5)) {
+    // only save if Flash/Sram in use or EEprom in use
+    switch (gbaSaveType) {
+    case 0:
+    case 5:
+        return NULL;
+    case 2:
+        size = flashSize;
+        return flashSaveMemory;
+    case 3:
+        size = eepromSize;
+        return eepromData;
+    default:
+        size = 0x8000;
+        return flashSaveMemory;
+    }
+}
+
+bool CPUWriteBatteryFile(const char* fileName)
+{
+    size_t size;
+    const uint8_t* data = CPUBatteryData(size);
+
+    if (data) {
         FILE* file = fopen(fileName, "wb");
 
         if (!file) {
@@ -973,29 +1165,146 @@ bool CPUWriteBatteryFile(const char* fileName)
             return false;
         }
 
-        // only save if Flash/Sram in use or EEprom in use
-        if (gbaSaveType != 3) {
-            if (gbaSaveType == 2) {
-                if (fwrite(flashSaveMemory, 1, flashSize, file) != (size_t)flashSize) {
-                    fclose(file);
-                    return false;
-                }
-            } else {
-                if (fwrite(flashSaveMemory, 1, 0x8000, file) != 0x8000) {
-                    fclose(file);
-                    return false;
-                }
-            }
-        } else {
-            if (fwrite(eepromData, 1, eepromSize, file) != (size_t)eepromSize) {
-                fclose(file);
+        if (fwrite(data, 1, size, file) != size) {
+            fclose(file);
+            return false;
+        }
+        fclose(file);
+    }
+    return true;
+}
+
+#if !defined(__LIBRETRO__) && !defined(_WIN32)
+// The .sav file mapped shared, so the kernel writes back whatever pages
+// are stored to. The save arrays live at fixed addresses (the memory map
+// and the state tables point into them), so the mapping mirrors them
+// rather than replacing them.
+//
+// Pages written in place can be torn by a crash, so the file is only
+// mapped once a whole copy of the save has safely reached the disk: the
+// first sync of a session, and the first after an error, write it to a
+// temporary file and rename that over the old one.
+static THREAD_STATE struct {
+    char fileName[2048];
+    int fd;
+    uint8_t* data;
+    size_t size;
+} batteryMap = { "", -1, NULL, 0 };
+
+#define BATTERY_PAGE_SIZE 0x1000
+
+static bool CPUWriteBatteryFileSafely(const char* fileName, const uint8_t* data, size_t size)
+{
+    char tempName[2048 + 4];
+    snprintf(tempName, sizeof(tempName), "%s.tmp", fileName);
+
+    FILE* file = fopen(tempName, "wb");
+    if (!file) {
+        systemMessage(MSG_ERROR_CREATING_FILE, N_("Error creating file %s"), tempName);
+        return false;
+    }
+
+    // The data has to be on the disk before the rename can be
+    bool ok = fwrite(data, 1, size, file) == size && fflush(file) == 0
+        && fsync(fileno(file)) == 0;
+    if (fclose(file) != 0)
+        ok = false;
+    if (ok)
+        ok = rename(tempName, fileName) == 0;
+    if (!ok)
+        remove(tempName);
+    return ok;
+}
+
+static bool CPUMapBatteryFile(const char* fileName, size_t size)
+{
+    int fd = open(fileName, O_RDWR);
+    if (fd < 0)
+        return false;
+
+    // Stores to a page the file system hasn't allocated could raise
+    // SIGBUS once the disk is full; reserve it all up front instead
+    struct stat st;
+    int err = posix_fallocate(fd, 0, size);
+    if ((err && err != EOPNOTSUPP && err != EINVAL) || fstat(fd, &st) != 0
+        || (size_t)st.st_size != size) {
+        close(fd);
+        return false;
+    }
+
+    void* data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        close(fd);
+        return false;
+    }
+
+    snprintf(batteryMap.fileName, sizeof(batteryMap.fileName), "%s", fileName);
+    batteryMap.fd = fd;
+    batteryMap.data = (uint8_t*)data;
+    batteryMap.size = size;
+    return true;
+}
+
+void CPUCloseBatteryFile()
+{
+    if (!batteryMap.data)
+        return;
+
+    msync(batteryMap.data, batteryMap.size, MS_SYNC);
+    munmap(batteryMap.data, batteryMap.size);
+    close(batteryMap.fd);
+    batteryMap.data = NULL;
+    batteryMap.fd = -1;
+}
+
+bool CPUSyncBatteryFile(const char* fileName)
+{
+    size_t size;
+    const uint8_t* data = CPUBatteryData(size);
+
+    if (!data)
+        return true;
+
+    if (batteryMap.data && (batteryMap.size != size || strcmp(batteryMap.fileName, fileName)))
+        CPUCloseBatteryFile();
+
+    if (!batteryMap.data) {
+        if (!CPUWriteBatteryFileSafely(fileName, data, size))
+            return false;
+        // Whatever keeps the file from being mapped, the next sync
+        // writes it whole again
+        CPUMapBatteryFile(fileName, size);
+        return true;
+    }
+
+    // Only pages that changed are stored to, and only those get written
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+    for (size_t offset = 0; offset < size; offset += BATTERY_PAGE_SIZE) {
+        size_t length = size - offset < BATTERY_PAGE_SIZE ? size - offset : BATTERY_PAGE_SIZE;
+
+        if (memcmp(batteryMap.data + offset, data + offset, length)) {
+            memcpy(batteryMap.data + offset, data + offset, length);
+            // msync wants the system's pages, which can be bigger
+            size_t start = offset - offset % pageSize;
+            if (msync(batteryMap.data + start, offset + length - start, MS_ASYNC) != 0) {
+                CPUCloseBatteryFile();
                 return false;
             }
         }
-        fclose(file);
     }
+
     return true;
 }
+#else
+void CPUCloseBatteryFile()
+{
+}
+
+bool CPUSyncBatteryFile(const char* fileName)
+{
+    return CPUWriteBatteryFile(fileName);
+}
+#endif
 
 bool CPUReadGSASnapshot(const char* fileName)
 {
@@ -1352,18 +1661,258 @@ bool CPUIsELF(const char* file)
     return false;
 }
 
-void CPUCleanUp()
+#if !defined(__LIBRETRO__) && !defined(_WIN32)
+// Plain images are mapped privately rather than read in: pages come from
+// the page cache, shared with anything else that has the file open, and
+// only pages the emulator stores to (patches, BIOS hooks) get copied. The
+// rest of the 32 MB is reserved address space that stays untouched
+// unless mirroring fills it.
+// With cpuRomPagingDir set nothing is read ahead of use, so only the
+// banks the game touches take memory, and the kernel drops the least
+// recently used ones again when it runs short.
+static uint8_t* CPUMapRom(const char* file, int& size)
 {
-#ifdef PROFILING
-    if (profilingTicksReload) {
-        profCleanup();
+    int fd = open(file, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0 || st.st_size > ROM_SIZE) {
+        close(fd);
+        return NULL;
+    }
+
+    void* area = mmap(NULL, ROM_SIZE, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (area == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+
+    int flags = MAP_PRIVATE | MAP_FIXED;
+#ifdef MAP_POPULATE
+    // fault it all in now rather than stall on first use during play
+    if (!cpuRomPagingDir)
+        flags |= MAP_POPULATE;
+#endif
+    void* image = mmap(area, st.st_size, PROT_READ | PROT_WRITE, flags, fd, 0);
+    close(fd);
+    if (image == MAP_FAILED) {
+        munmap(area, ROM_SIZE);
+        return NULL;
+    }
+    if (!cpuRomPagingDir)
+        madvise(image, st.st_size, MADV_WILLNEED);
+
+    size = (int)st.st_size;
+    romMapped = true;
+    return (uint8_t*)area;
+}
+
+// Archives are unpacked to a file in cpuRomPagingDir that is then mapped
+// like a plain image. It is unlinked right away, the mapping keeps it.
+static uint8_t* CPUUnpackRom(const char* file, int& size)
+{
+    char tempName[2048];
+
+    snprintf(tempName, sizeof(tempName), "%s/vbam-rom-XXXXXX", cpuRomPagingDir);
+    int fd = mkstemp(tempName);
+    if (fd < 0)
+        return NULL;
+    close(fd);
+
+    uint8_t* area = NULL;
+    // multiboot images are loaded to work RAM, leave those to utilLoad
+    if (utilUnpack(file, utilIsGBAImage, tempName) > 0 && !cpuIsMultiBoot)
+        area = CPUMapRom(tempName, size);
+
+    unlink(tempName);
+    return area;
+}
+
+// Cached images are named after a CRC of the archive's full path, size
+// and modification time, so a changed or moved archive misses by itself.
+static bool CPURomCacheName(const char* file, char* name, size_t size)
+{
+    struct stat st;
+    if (stat(file, &st) != 0)
+        return false;
+
+    char path[PATH_MAX];
+    if (!realpath(file, path))
+        snprintf(path, sizeof(path), "%s", file);
+
+    uint8_t key[16];
+    utilPutDword(key, (uint32_t)st.st_size);
+    utilPutDword(key + 4, (uint32_t)((uint64_t)st.st_size >> 32));
+    utilPutDword(key + 8, (uint32_t)st.st_mtime);
+    utilPutDword(key + 12, (uint32_t)((uint64_t)st.st_mtime >> 32));
+
+    uLong crc = crc32(0L, (const Bytef*)path, strlen(path));
+    snprintf(name, size, "%s/%08lx%08lx.gba", cpuRomCacheDir, crc,
+        crc32(0L, key, sizeof(key)));
+    return true;
+}
+
+// Deletes the least recently used images until the cache fits in
+// cpuRomCacheSize, keeping the one just added. A hit touches the file, so
+// its modification time is the last use.
+static void CPUTrimRomCache(const char* keep)
+{
+    struct entry {
+        char name[2048];
+        off_t size;
+        time_t used;
+    };
+
+    DIR* dir = opendir(cpuRomCacheDir);
+    if (!dir)
+        return;
+
+    entry* entries = NULL;
+    int count = 0, allocated = 0;
+    uint64_t total = 0;
+    struct dirent* de;
+
+    while ((de = readdir(dir)) != NULL) {
+        size_t len = strlen(de->d_name);
+        if (len != 20 || strcmp(de->d_name + 16, ".gba") != 0)
+            continue;
+
+        if (count == allocated) {
+            allocated = allocated ? allocated * 2 : 16;
+            entry* grown = (entry*)realloc(entries, allocated * sizeof(entry));
+            if (!grown)
+                break;
+            entries = grown;
+        }
+
+        entry& e = entries[count];
+        struct stat st;
+        snprintf(e.name, sizeof(e.name), "%s/%s", cpuRomCacheDir, de->d_name);
+        if (stat(e.name, &st) != 0)
+            continue;
+        e.size = st.st_size;
+        e.used = st.st_mtime;
+        total += st.st_size;
+        count++;
+    }
+    closedir(dir);
+
+    while (total > cpuRomCacheSize) {
+        int oldest = -1;
+        for (int i = 0; i < count; i++)
+            if (entries[i].size >= 0 && strcmp(entries[i].name, keep) != 0
+                && (oldest < 0 || entries[i].used < entries[oldest].used))
+                oldest = i;
+        if (oldest < 0)
+            break;
+
+        // images other instances still have mapped stay valid for them
+        unlink(entries[oldest].name);
+        total -= entries[oldest].size;
+        entries[oldest].size = -1;
+    }
+
+    free(entries);
+}
+
+// Archives are unpacked once into cpuRomCacheDir; after that loading one
+// costs a stat and a mmap of the cached image.
+static uint8_t* CPUCachedRom(const char* file, int& size)
+{
+    char name[2048];
+    if (cpuIsMultiBoot || !CPURomCacheName(file, name, sizeof(name)))
+        return NULL;
+
+    uint8_t* area = CPUMapRom(name, size);
+    if (area) {
+        utime(name, NULL);
+        return area;
+    }
+
+    // unpacked under a temporary name, so nothing maps a partial image
+    char tempName[2048];
+    snprintf(tempName, sizeof(tempName), "%s/vbam-rom-XXXXXX", cpuRomCacheDir);
+    int fd = mkstemp(tempName);
+    if (fd < 0)
+        return NULL;
+    close(fd);
+
+    if (utilUnpack(file, utilIsGBAImage, tempName) > 0 && rename(tempName, name) == 0) {
+        if (cpuRomCacheSize)
+            CPUTrimRomCache(name);
+        return CPUMapRom(name, size);
+    }
+
+    unlink(tempName);
+    return NULL;
+}
+
+int CPURomBankResidency(uint8_t* banks, int count)
+{
+    if (!romMapped)
+        return 0;
+
+    long pageSize = sysconf(_SC_PAGESIZE);
+    size_t pages = (romSize + pageSize - 1) / pageSize;
+    unsigned char* resident = (unsigned char*)malloc(pages);
+
+    if (!resident || mincore(rom, pages * pageSize, resident) != 0) {
+        free(resident);
+        return 0;
+    }
+
+    int total = (romSize + ROM_BANK_SIZE - 1) / ROM_BANK_SIZE;
+    size_t pagesPerBank = ROM_BANK_SIZE / pageSize;
+    if (pagesPerBank == 0)
+        pagesPerBank = 1;
+
+    for (int bank = 0; bank < total && bank < count; bank++) {
+        size_t first = bank * pagesPerBank;
+        size_t in = 0, n = 0;
+
+        for (size_t page = first; page < first + pagesPerBank && page < pages; page++, n++)
+            in += resident[page] & 1;
+        banks[bank] = (uint8_t)(n ? in * 100 / n : 0);
     }
+
+    free(resident);
+    return total;
+}
+#else
+int CPURomBankResidency(uint8_t* banks, int count)
+{
+    return 0;
+}
 #endif
 
+static void CPUFreeRom()
+{
+#if !defined(__LIBRETRO__) && !defined(_WIN32)
+    if (romMapped) {
+        munmap(rom, ROM_SIZE);
+        romMapped = false;
+        rom = NULL;
+    }
+#endif
     if (rom != NULL) {
         free(rom);
         rom = NULL;
     }
+}
+
+void CPUCleanUp()
+{
+#ifdef PROFILING
+    if (profilingTicksReload) {
+        profCleanup();
+    }
+#endif
+
+    CPUCloseBatteryFile();
+
+    CPUFreeRom();
 
     if (vram != NULL) {
         free(vram);
@@ -1460,7 +2009,21 @@ int CPULoadRom(const char* szFile)
 
     systemSaveUpdateCounter = SYSTEM_SAVE_NOT_UPDATED;
 
-    rom = (uint8_t*)malloc(romSize);
+#if !defined(__LIBRETRO__) && !defined(_WIN32)
+    if (cpuRomMapEnabled && szFile != NULL && !CPUIsELF(szFile)) {
+        if (utilIsGBAImage(szFile)) {
+            if (!cpuIsMultiBoot)
+                rom = CPUMapRom(szFile, romSize);
+        } else {
+            if (cpuRomCacheDir)
+                rom = CPUCachedRom(szFile, romSize);
+            if (rom == NULL && cpuRomPagingDir)
+                rom = CPUUnpackRom(szFile, romSize);
+        }
+    }
+    if (rom == NULL)
+#endif
+        rom = (uint8_t*)malloc(romSize);
     if (rom == NULL) {
         systemMessage(MSG_OUT_OF_MEMORY, N_("Failed to allocate memory for %s"),
             "ROM");
@@ -1481,16 +2044,14 @@ int CPULoadRom(const char* szFile)
         if (!f) {
             systemMessage(MSG_ERROR_OPENING_IMAGE, N_("Error opening image %s"),
                 szFile);
-            free(rom);
-            rom = NULL;
+            CPUFreeRom();
             free(workRAM);
             workRAM = NULL;
             return 0;
         }
         bool res = elfRead(szFile, romSize, f);
         if (!res || romSize == 0) {
-            free(rom);
-            rom = NULL;
+            CPUFreeRom();
             free(workRAM);
             workRAM = NULL;
             elfCleanUp();
@@ -1498,25 +2059,26 @@ int CPULoadRom(const char* szFile)
         }
     } else
 #endif //NO_DEBUGGER
+#if !defined(__LIBRETRO__) && !defined(_WIN32)
+        if (romMapped) {
+        // already in place
+    } else
+#endif
         if (szFile != NULL) {
         if (!utilLoad(szFile,
                 utilIsGBAImage,
                 whereToLoad,
                 romSize)) {
-            free(rom);
-            rom = NULL;
+            CPUFreeRom();
             free(workRAM);
             workRAM = NULL;
             return 0;
         }
     }
 
-    uint16_t* temp = (uint16_t*)(rom + ((romSize + 1) & ~1));
-    int i;
-    for (i = (romSize + 1) & ~1; i < romSize; i += 2) {
-        WRITE16LE(temp, (i >> 1) & 0xFFFF);
-        temp++;
-    }
+    // Reads past the image are answered by CPURead* without filling it in
+    romMirrored = false;
+    CPUUpdateRomOpenBus();
 
     bios = (uint8_t*)calloc(1, 0x4000);
     if (bios == NULL) {
@@ -1604,12 +2166,9 @@ int CPULoadRomData(const char* data, int size)
     romSize = size % 2 == 0 ? size : size + 1;
     memcpy(whereToLoad, data, size);
 
-    uint16_t* temp = (uint16_t*)(rom + ((romSize + 1) & ~1));
-    int i;
-    for (i = (romSize + 1) & ~1; i < romSize; i += 2) {
-        WRITE16LE(temp, (i >> 1) & 0xFFFF);
-        temp++;
-    }
+    // Reads past the image are answered by CPURead* without filling it in
+    romMirrored = false;
+    CPUUpdateRomOpenBus();
 
     bios = (uint8_t*)calloc(1, 0x4000);
     if (bios == NULL) {
@@ -1689,9 +2248,17 @@ void doMirroring(bool b)
             memcpy((uint16_t*)(rom + mirroredRomAddress), (uint16_t*)(rom), mirroredRomSize);
             mirroredRomAddress += mirroredRomSize;
         }
+        romMirrored = true;
+        CPUUpdateRomOpenBus();
     }
 }
 
+void CPUSetRomSize(int size)
+{
+    romSize = size;
+    CPUUpdateRomOpenBus();
+}
+
 const char* GetLoadDotCodeFile()
 {
     return loadDotCodeFile;
@@ -1972,7 +2539,7 @@ void CPUSoftwareInterrupt()
 
 void CPUSoftwareInterrupt(int comment)
 {
-    static bool disableMessage = false;
+    static THREAD_STATE bool disableMessage = false;
     if (armState)
         comment >>= 16;
 #ifdef BKPT_SUPPORT
@@ -2301,8 +2868,25 @@ void CPUCompareVCOUNT()
     }
 }
 
+uint64_t CPUTimingNow()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Charges the time since start to what, and returns now for the next part
+static inline uint64_t CPUTimingAdd(int what, uint64_t start)
+{
+    uint64_t now = CPUTimingNow();
+    cpuTiming[what] += now - start;
+    return now;
+}
+
 void doDMA(uint32_t& s, uint32_t& d, uint32_t si, uint32_t di, uint32_t c, int transfer32)
 {
+    // a DMA started by this one's writes is counted as part of it
+    uint64_t timingStart = cpuTimingEnabled && !cpuDmaHack ? CPUTimingNow() : 0;
     int sm = s >> 24;
     int dm = d >> 24;
     int sw = 0;
@@ -2375,6 +2959,9 @@ void doDMA(uint32_t& s, uint32_t& d, uint32_t si, uint32_t di, uint32_t c, int t
 
     cpuDmaTicksToUpdate += totalTicks;
     cpuDmaHack = false;
+
+    if (timingStart)
+        CPUTimingAdd(TIMING_DMA, timingStart);
 }
 
 void CPUCheckDMA(int reason, int dmamask)
@@ -3188,8 +3775,8 @@ void applyTimer()
     timerOnOffDelay = 0;
 }
 
-uint8_t cpuBitsSet[256];
-uint8_t cpuLowestBitSet[256];
+THREAD_STATE uint8_t cpuBitsSet[256];
+THREAD_STATE uint8_t cpuLowestBitSet[256];
 
 void CPUInit(const char* biosFileName, bool useBiosFile)
 {
@@ -3284,6 +3871,7 @@ void CPUInit(const char* biosFileName, bool useBiosFile)
     } else {
         agbPrintEnable(false);
     }
+    CPUUpdateRomOpenBus();
 }
 
 void SetSaveType(int st)
@@ -3379,6 +3967,8 @@ void CPUReset()
     memset(pix, 0, 2 * (240 * 160));
     // clean vram
     memset(vram, 0, 0x20000);
+    // nothing left in common with any incremental state
+    CPUMarkAllDirty();
     // clean io memory
     memset(ioMem, 0, 0x400);
 
@@ -3616,6 +4206,48 @@ void CPUInterrupt()
     biosProtected[3] = 0xe5;
 }
 
+// Requests the keypad interrupt if KEYCNT asks for it with the keys in P1
+static void CPUCheckKeyInterrupt()
+{
+    uint16_t P1CNT = READ16LE(((uint16_t*)&ioMem[0x132]));
+    // this seems wrong, but there are cases where the game
+    // can enter the stop state without requesting an IRQ from
+    // the joypad.
+    if ((P1CNT & 0x4000) || stopState) {
+        uint16_t p1 = (0x3FF ^ P1) & 0x3FF;
+        if (P1CNT & 0x8000) {
+            if (p1 == (P1CNT & 0x3FF)) {
+                IF |= 0x1000;
+                UPDATE_REG(0x202, IF);
+            }
+        } else {
+            if (p1 & P1CNT) {
+                IF |= 0x1000;
+                UPDATE_REG(0x202, IF);
+            }
+        }
+    }
+}
+
+void CPUUpdateKeyInput()
+{
+    // Movies only have the pad as it was latched
+    if (movieRecording() || moviePlaying())
+        return;
+
+    uint32_t joy = 0;
+
+    // Autofire only alternates with the latch every frame
+    if (systemReadJoypads())
+        joy = systemPollJoypad(-1);
+    P1 = 0x03FF ^ (joy & 0x3FF);
+    UPDATE_REG(0x130, P1);
+
+    CPUCheckKeyInterrupt();
+    if ((IME & 1) && (IF & IE) && armIrqEnable)
+        cpuNextEvent = cpuTotalTicks;
+}
+
 void CPULoop(int ticks)
 {
     int clockTicks;
@@ -3704,7 +4336,9 @@ void CPULoop(int ticks)
                 } else {
                     int framesToSkip = systemFrameSkip;
                     if (speedup)
-                        framesToSkip = 9; // try 6 FPS during speedup
+                        framesToSkip = cpuSpeedupFrameSkip;
+                    if (!cpuRenderEnabled)
+                        framesToSkip = 0x7fffffff;
 
                     if (DISPSTAT & 2) {
                         // if in H-Blank, leave it and move to drawing mode
@@ -3735,27 +4369,11 @@ void CPULoop(int ticks)
                             if (systemReadJoypads())
                                 // read default joystick
                                 joy = systemReadJoypad(-1);
+                            joy = movieUpdateJoypad(joy);
                             P1 = 0x03FF ^ (joy & 0x3FF);
                             systemUpdateMotionSensor();
                             UPDATE_REG(0x130, P1);
-                            uint16_t P1CNT = READ16LE(((uint16_t*)&ioMem[0x132]));
-                            // this seems wrong, but there are cases where the game
-                            // can enter the stop state without requesting an IRQ from
-                            // the joypad.
-                            if ((P1CNT & 0x4000) || stopState) {
-                                uint16_t p1 = (0x3FF ^ P1) & 0x3FF;
-                                if (P1CNT & 0x8000) {
-                                    if (p1 == (P1CNT & 0x3FF)) {
-                                        IF |= 0x1000;
-                                        UPDATE_REG(0x202, IF);
-                                    }
-                                } else {
-                                    if (p1 & P1CNT) {
-                                        IF |= 0x1000;
-                                        UPDATE_REG(0x202, IF);
-                                    }
-                                }
-                            }
+                            CPUCheckKeyInterrupt();
 
                             uint32_t ext = (joy >> 10);
 
@@ -3777,7 +4395,10 @@ void CPULoop(int ticks)
                             }
                             CPUCheckDMA(1, 0x0f);
                             if (frameCount >= framesToSkip) {
+                                uint64_t timingStart = cpuTimingEnabled ? CPUTimingNow() : 0;
                                 systemDrawScreen();
+                                if (cpuTimingEnabled)
+                                    CPUTimingAdd(TIMING_PRESENT, timingStart);
                                 frameCount = 0;
                             } else
                                 frameCount++;
@@ -3790,7 +4411,10 @@ void CPULoop(int ticks)
 
                     } else {
                         if (frameCount >= framesToSkip) {
+                            uint64_t timingStart = cpuTimingEnabled ? CPUTimingNow() : 0;
                             (*renderLine)();
+                            if (cpuTimingEnabled)
+                                timingStart = CPUTimingAdd(TIMING_RENDER, timingStart);
                             switch (systemColorDepth) {
                             case 16: {
                                 uint16_t* dest = (uint16_t*)pix + 240 * VCOUNT;
@@ -3881,6 +4505,8 @@ void CPULoop(int ticks)
                                 }
                             } break;
                             }
+                            if (cpuTimingEnabled)
+                                CPUTimingAdd(TIMING_CONVERT, timingStart);
                         }
                         // entering H-Blank
                         DISPSTAT |= 2;
@@ -3900,7 +4526,10 @@ void CPULoop(int ticks)
             // mute sound
             soundTicks -= clockTicks;
             if (soundTicks <= 0) {
+                uint64_t timingStart = cpuTimingEnabled ? CPUTimingNow() : 0;
                 psoundTickfn();
+                if (cpuTimingEnabled)
+                    CPUTimingAdd(TIMING_SOUND, timingStart);
                 soundTicks += SOUND_CLOCK_TICKS;
             }
 
@@ -60,28 +60,63 @@ typedef union {
 } reg_pair;
 
 #ifndef NO_GBA_MAP
-extern memoryMap map[256];
+extern THREAD_STATE memoryMap map[256];
 #endif
 
-extern uint8_t biosProtected[4];
-
-extern void (*cpuSaveGameFunc)(uint32_t, uint8_t);
-
-extern bool cpuSramEnabled;
-extern bool cpuFlashEnabled;
-extern bool cpuEEPROMEnabled;
-extern bool cpuEEPROMSensorEnabled;
+extern THREAD_STATE uint8_t biosProtected[4];
+
+extern THREAD_STATE void (*cpuSaveGameFunc)(uint32_t, uint8_t);
+
+extern THREAD_STATE bool cpuSramEnabled;
+extern THREAD_STATE bool cpuFlashEnabled;
+extern THREAD_STATE bool cpuEEPROMEnabled;
+extern THREAD_STATE bool cpuEEPROMSensorEnabled;
+extern THREAD_STATE bool cpuRenderEnabled;
+// Reads of KEYINPUT ask the frontend for the pad again instead of seeing
+// what was latched at the start of VBlank
+extern THREAD_STATE bool cpuKeyInputPolling;
+// Frames left undrawn for each one drawn while speedup is held, the
+// frontend may tune it to how fast the core actually runs
+extern THREAD_STATE int cpuSpeedupFrameSkip;
+extern void CPUUpdateKeyInput();
+// CPULoadRom maps plain image files instead of reading them in. Turn it
+// off when the buffer is going to be realloc()ed (applyPatch).
+extern bool cpuRomMapEnabled;
+// Set to a directory to page the ROM in on demand instead of holding all
+// of it: nothing is read ahead, and archives are unpacked to a file there
+// rather than to memory.
+extern const char* cpuRomPagingDir;
+// Set to a directory to keep unpacked copies of archived ROMs in, so the
+// next load maps the copy instead of decompressing again. Least recently
+// used copies are deleted past cpuRomCacheSize bytes, 0 for no limit.
+extern const char* cpuRomCacheDir;
+extern uint64_t cpuRomCacheSize;
+
+// Where CPULoop's time goes while cpuTimingEnabled is set, in nanoseconds
+// of CPUTimingNow(). The CPU itself gets what is left of the total.
+enum {
+    TIMING_RENDER, // renderLine
+    TIMING_CONVERT, // lineMix to pix
+    TIMING_SOUND, // psoundTickfn
+    TIMING_DMA, // doDMA
+    TIMING_PRESENT, // systemDrawScreen
+    TIMING_SOUND_WAIT, // the sound driver's write, taken out of TIMING_SOUND
+    TIMING_COUNT
+};
+extern THREAD_STATE bool cpuTimingEnabled;
+extern THREAD_STATE uint64_t cpuTiming[TIMING_COUNT];
+extern uint64_t CPUTimingNow();
 
 #ifdef BKPT_SUPPORT
-extern uint8_t freezeWorkRAM[0x40000];
-extern uint8_t freezeInternalRAM[0x8000];
-extern uint8_t freezeVRAM[0x18000];
-extern uint8_t freezeOAM[0x400];
-extern uint8_t freezePRAM[0x400];
-extern bool debugger_last;
-extern int oldreg[18];
-extern char oldbuffer[10];
-extern bool debugger;
+extern THREAD_STATE uint8_t freezeWorkRAM[0x40000];
+extern THREAD_STATE uint8_t freezeInternalRAM[0x8000];
+extern THREAD_STATE uint8_t freezeVRAM[0x18000];
+extern THREAD_STATE uint8_t freezeOAM[0x400];
+extern THREAD_STATE uint8_t freezePRAM[0x400];
+extern THREAD_STATE bool debugger_last;
+extern THREAD_STATE int oldreg[18];
+extern THREAD_STATE char oldbuffer[10];
+extern THREAD_STATE bool debugger;
 #endif
 
 extern bool CPUReadGSASnapshot(const char*);
@@ -89,6 +124,11 @@ extern bool CPUReadGSASPSnapshot(const char*);
 extern bool CPUWriteGSASnapshot(const char*, const char*, const char*, const char*);
 extern bool CPUWriteBatteryFile(const char*);
 extern bool CPUReadBatteryFile(const char*);
+// Keeps the .sav file mapped and writes back only the pages that changed.
+// The first sync, and any after an error, replace the file whole through
+// a temporary one instead, so a crash leaves a complete save.
+extern bool CPUSyncBatteryFile(const char*);
+extern void CPUCloseBatteryFile();
 extern bool CPUExportEepromFile(const char*);
 extern bool CPUImportEepromFile(const char*);
 extern bool CPUWritePNGFile(const char*);
@@ -97,10 +137,27 @@ extern void CPUCleanUp();
 extern void CPUUpdateRender();
 extern void CPUUpdateRenderBuffers(bool);
 extern bool CPUReadMemState(char*, int);
-extern bool CPUWriteMemState(char*, int);
+extern bool CPUWriteMemState(char*, int, long&);
+extern unsigned CPURawStateSize();
+extern unsigned CPUWriteRawState(uint8_t* data, unsigned size);
+// loadSound false leaves the sound core alone (see soundRunAheadBegin)
+extern bool CPUReadRawState(const uint8_t* data, unsigned size, bool loadSound = true);
+// Incremental raw states. The last buffer passed to CPUWriteRawStateDirty
+// is the base: writing it again only copies the memory pages stored to
+// since, and CPUReadRawStateDirty on it only copies those pages back. Any
+// other buffer gets a whole state, and becomes the base when written.
+extern unsigned CPUWriteRawStateDirty(uint8_t* data, unsigned size);
+extern bool CPUReadRawStateDirty(const uint8_t* data, unsigned size, bool loadSound = true);
+// For code changing memory behind the store paths' back
+extern void CPUMarkAllDirty();
+// How much of each ROM_BANK_SIZE bank of a mapped ROM is in memory, in
+// percent. Fills up to count entries, returns the number of banks, 0 if
+// the ROM isn't mapped.
+extern int CPURomBankResidency(uint8_t* banks, int count);
+// Uncompressed savestate contents; CPURawStateSize() bytes always fit
+extern unsigned int CPUWriteState(uint8_t* data, unsigned int size);
 #ifdef __LIBRETRO__
 extern bool CPUReadState(const uint8_t*, unsigned);
-extern unsigned int CPUWriteState(uint8_t* data, unsigned int size);
 #else
 extern bool CPUReadState(const char*);
 extern bool CPUWriteState(const char*);
@@ -108,6 +165,8 @@ extern bool CPUWriteState(const char*);
 extern int CPULoadRom(const char*);
 extern int CPULoadRomData(const char* data, int size);
 extern void doMirroring(bool);
+// For patches that grow the image after CPULoadRom
+extern void CPUSetRomSize(int size);
 extern void CPUUpdateRegister(uint32_t, uint16_t);
 extern void applyTimer();
 extern void CPUInit(const char*, bool);
@@ -155,6 +214,7 @@ extern struct EmulatedSystem GBASystem;
 
 #define WORK_RAM_SIZE 0x40000
 #define ROM_SIZE      0x2000000
+#define ROM_BANK_SIZE 0x10000
 
 #include "EEprom.h"
 #include "Flash.h"
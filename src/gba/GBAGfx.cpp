@@ -7,25 +7,25 @@ int coeff[32] = {
     16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16
 };
 
-uint32_t line0[240];
-uint32_t line1[240];
-uint32_t line2[240];
-uint32_t line3[240];
-uint32_t lineOBJ[240];
-uint32_t lineOBJWin[240];
-uint32_t lineMix[240];
-bool gfxInWin0[240];
-bool gfxInWin1[240];
-int lineOBJpixleft[128];
-
-int gfxBG2Changed = 0;
-int gfxBG3Changed = 0;
-
-int gfxBG2X = 0;
-int gfxBG2Y = 0;
-int gfxBG3X = 0;
-int gfxBG3Y = 0;
-int gfxLastVCOUNT = 0;
+THREAD_STATE uint32_t line0[240];
+THREAD_STATE uint32_t line1[240];
+THREAD_STATE uint32_t line2[240];
+THREAD_STATE uint32_t line3[240];
+THREAD_STATE uint32_t lineOBJ[240];
+THREAD_STATE uint32_t lineOBJWin[240];
+THREAD_STATE uint32_t lineMix[240];
+THREAD_STATE bool gfxInWin0[240];
+THREAD_STATE bool gfxInWin1[240];
+THREAD_STATE int lineOBJpixleft[128];
+
+THREAD_STATE int gfxBG2Changed = 0;
+THREAD_STATE int gfxBG3Changed = 0;
+
+THREAD_STATE int gfxBG2X = 0;
+THREAD_STATE int gfxBG2Y = 0;
+THREAD_STATE int gfxBG3X = 0;
+THREAD_STATE int gfxBG3Y = 0;
+THREAD_STATE int gfxLastVCOUNT = 0;
 
 #ifdef TILED_RENDERING
 #ifdef _MSC_VER
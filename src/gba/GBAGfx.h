@@ -50,25 +50,25 @@ void mode5RenderLineNoWindow();
 void mode5RenderLineAll();
 
 extern int coeff[32];
-extern uint32_t line0[240];
-extern uint32_t line1[240];
-extern uint32_t line2[240];
-extern uint32_t line3[240];
-extern uint32_t lineOBJ[240];
-extern uint32_t lineOBJWin[240];
-extern uint32_t lineMix[240];
-extern bool gfxInWin0[240];
-extern bool gfxInWin1[240];
-extern int lineOBJpixleft[128];
-
-extern int gfxBG2Changed;
-extern int gfxBG3Changed;
-
-extern int gfxBG2X;
-extern int gfxBG2Y;
-extern int gfxBG3X;
-extern int gfxBG3Y;
-extern int gfxLastVCOUNT;
+extern THREAD_STATE uint32_t line0[240];
+extern THREAD_STATE uint32_t line1[240];
+extern THREAD_STATE uint32_t line2[240];
+extern THREAD_STATE uint32_t line3[240];
+extern THREAD_STATE uint32_t lineOBJ[240];
+extern THREAD_STATE uint32_t lineOBJWin[240];
+extern THREAD_STATE uint32_t lineMix[240];
+extern THREAD_STATE bool gfxInWin0[240];
+extern THREAD_STATE bool gfxInWin1[240];
+extern THREAD_STATE int lineOBJpixleft[128];
+
+extern THREAD_STATE int gfxBG2Changed;
+extern THREAD_STATE int gfxBG3Changed;
+
+extern THREAD_STATE int gfxBG2X;
+extern THREAD_STATE int gfxBG2Y;
+extern THREAD_STATE int gfxBG3X;
+extern THREAD_STATE int gfxBG3Y;
+extern THREAD_STATE int gfxLastVCOUNT;
 
 static inline void gfxClearArray(uint32_t* array)
 {
@@ -39,21 +39,21 @@ extern int thumbExecute();
 
 #define THUMB_PREFETCH_NEXT cpuPrefetch[1] = CPUReadHalfWordQuick(armNextPC + 2);
 
-extern int SWITicks;
-extern uint32_t mastercode;
-extern bool busPrefetch;
-extern bool busPrefetchEnable;
-extern uint32_t busPrefetchCount;
-extern int cpuNextEvent;
-extern bool holdState;
-extern uint32_t cpuPrefetch[2];
-extern int cpuTotalTicks;
-extern uint8_t memoryWait[16];
-extern uint8_t memoryWait32[16];
-extern uint8_t memoryWaitSeq[16];
-extern uint8_t memoryWaitSeq32[16];
-extern uint8_t cpuBitsSet[256];
-extern uint8_t cpuLowestBitSet[256];
+extern THREAD_STATE int SWITicks;
+extern THREAD_STATE uint32_t mastercode;
+extern THREAD_STATE bool busPrefetch;
+extern THREAD_STATE bool busPrefetchEnable;
+extern THREAD_STATE uint32_t busPrefetchCount;
+extern THREAD_STATE int cpuNextEvent;
+extern THREAD_STATE bool holdState;
+extern THREAD_STATE uint32_t cpuPrefetch[2];
+extern THREAD_STATE int cpuTotalTicks;
+extern THREAD_STATE uint8_t memoryWait[16];
+extern THREAD_STATE uint8_t memoryWait32[16];
+extern THREAD_STATE uint8_t memoryWaitSeq[16];
+extern THREAD_STATE uint8_t memoryWaitSeq32[16];
+extern THREAD_STATE uint8_t cpuBitsSet[256];
+extern THREAD_STATE uint8_t cpuLowestBitSet[256];
 extern void CPUSwitchMode(int mode, bool saveState, bool breakLoop);
 extern void CPUSwitchMode(int mode, bool saveState);
 extern void CPUUpdateCPSR();
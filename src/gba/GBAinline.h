@@ -11,30 +11,33 @@
 #include "remote.h"
 
 extern const uint32_t objTilesAddress[3];
-
-extern bool stopState;
-extern bool holdState;
-extern int holdType;
-extern int cpuNextEvent;
-extern bool cpuSramEnabled;
-extern bool cpuFlashEnabled;
-extern bool cpuEEPROMEnabled;
-extern bool cpuEEPROMSensorEnabled;
-extern bool cpuDmaHack;
-extern uint32_t cpuDmaLast;
-extern bool timer0On;
-extern int timer0Ticks;
-extern int timer0ClockReload;
-extern bool timer1On;
-extern int timer1Ticks;
-extern int timer1ClockReload;
-extern bool timer2On;
-extern int timer2Ticks;
-extern int timer2ClockReload;
-extern bool timer3On;
-extern int timer3Ticks;
-extern int timer3ClockReload;
-extern int cpuTotalTicks;
+extern THREAD_STATE uint32_t cpuRomOpenBus;
+
+extern THREAD_STATE bool stopState;
+extern THREAD_STATE bool holdState;
+extern THREAD_STATE int holdType;
+extern THREAD_STATE int cpuNextEvent;
+extern THREAD_STATE bool cpuSramEnabled;
+extern THREAD_STATE bool cpuFlashEnabled;
+extern THREAD_STATE bool cpuEEPROMEnabled;
+extern THREAD_STATE bool cpuEEPROMSensorEnabled;
+extern THREAD_STATE bool cpuKeyInputPolling;
+extern void CPUUpdateKeyInput();
+extern THREAD_STATE bool cpuDmaHack;
+extern THREAD_STATE uint32_t cpuDmaLast;
+extern THREAD_STATE bool timer0On;
+extern THREAD_STATE int timer0Ticks;
+extern THREAD_STATE int timer0ClockReload;
+extern THREAD_STATE bool timer1On;
+extern THREAD_STATE int timer1Ticks;
+extern THREAD_STATE int timer1ClockReload;
+extern THREAD_STATE bool timer2On;
+extern THREAD_STATE int timer2Ticks;
+extern THREAD_STATE int timer2ClockReload;
+extern THREAD_STATE bool timer3On;
+extern THREAD_STATE int timer3Ticks;
+extern THREAD_STATE int timer3ClockReload;
+extern THREAD_STATE int cpuTotalTicks;
 
 #define CPUReadByteQuick(addr) map[(addr) >> 24].address[(addr)&map[(addr) >> 24].mask]
 
@@ -89,6 +92,8 @@ static inline uint32_t CPUReadMemory(uint32_t address)
         break;
     case 4:
         if ((address < 0x4000400) && ioReadable[address & 0x3fc]) {
+            if (((address & 0x3fc) == 0x130) && cpuKeyInputPolling)
+                CPUUpdateKeyInput();
             if (ioReadable[(address & 0x3fc) + 2]) {
                 value = READ32LE(((uint32_t*)&ioMem[address & 0x3fC]));
                 if ((address & 0x3fc) == COMM_JOY_RECV_L)
@@ -121,6 +126,11 @@ static inline uint32_t CPUReadMemory(uint32_t address)
     case 10:
     case 11:
     case 12:
+        if ((address & 0x1FFFFFC) >= cpuRomOpenBus) {
+            // past the image the bus still holds the halfword address
+            value = ((address >> 1) & 0xFFFE) | ((((address >> 1) | 1) & 0xFFFF) << 16);
+            break;
+        }
         value = READ32LE(((uint32_t*)&rom[address & 0x1FFFFFC]));
         break;
     case 13:
@@ -234,6 +244,8 @@ static inline uint32_t CPUReadHalfWord(uint32_t address)
         break;
     case 4:
         if ((address < 0x4000400) && ioReadable[address & 0x3fe]) {
+            if (((address & 0x3fe) == 0x130) && cpuKeyInputPolling)
+                CPUUpdateKeyInput();
             value = READ16LE(((uint16_t*)&ioMem[address & 0x3fe]));
             if (((address & 0x3fe) > 0xFF) && ((address & 0x3fe) < 0x10E)) {
                 if (((address & 0x3fe) == 0x100) && timer0On)
@@ -273,6 +285,8 @@ static inline uint32_t CPUReadHalfWord(uint32_t address)
     case 12:
         if (address == 0x80000c4 || address == 0x80000c6 || address == 0x80000c8)
             value = rtcRead(address);
+        else if ((address & 0x1FFFFFE) >= cpuRomOpenBus)
+            value = (address >> 1) & 0xFFFF;
         else
             value = READ16LE(((uint16_t*)&rom[address & 0x1FFFFFE]));
         break;
@@ -373,9 +387,11 @@ static inline uint8_t CPUReadByte(uint32_t address)
     case 3:
         return internalRAM[address & 0x7fff];
     case 4:
-        if ((address < 0x4000400) && ioReadable[address & 0x3ff])
+        if ((address < 0x4000400) && ioReadable[address & 0x3ff]) {
+            if (((address & 0x3fe) == 0x130) && cpuKeyInputPolling)
+                CPUUpdateKeyInput();
             return ioMem[address & 0x3ff];
-        else
+        } else
             goto unreadable;
     case 5:
         return paletteRAM[address & 0x3ff];
@@ -393,6 +409,8 @@ static inline uint8_t CPUReadByte(uint32_t address)
     case 10:
     case 11:
     case 12:
+        if ((address & 0x1FFFFFF) >= cpuRomOpenBus)
+            return (uint8_t)(((address >> 1) & 0xFFFF) >> ((address & 1) << 3));
         return rom[address & 0x1FFFFFF];
     case 13:
         if (cpuEEPROMEnabled)
@@ -461,6 +479,7 @@ static inline void CPUWriteMemory(uint32_t address, uint32_t value)
 
     switch (address >> 24) {
     case 0x02:
+        dirtyWorkRAM[(address & 0x3FFFC) >> DIRTY_PAGE_SHIFT] = 1;
 #ifdef BKPT_SUPPORT
         if (*((uint32_t*)&freezeWorkRAM[address & 0x3FFFC]))
             cheatsWriteMemory(address & 0x203FFFC, value);
@@ -469,6 +488,7 @@ static inline void CPUWriteMemory(uint32_t address, uint32_t value)
             WRITE32LE(((uint32_t*)&workRAM[address & 0x3FFFC]), value);
         break;
     case 0x03:
+        dirtyInternalRAM[(address & 0x7ffC) >> DIRTY_PAGE_SHIFT] = 1;
 #ifdef BKPT_SUPPORT
         if (*((uint32_t*)&freezeInternalRAM[address & 0x7ffc]))
             cheatsWriteMemory(address & 0x3007FFC, value);
@@ -497,6 +517,7 @@ static inline void CPUWriteMemory(uint32_t address, uint32_t value)
             return;
         if ((address & 0x18000) == 0x18000)
             address &= 0x17fff;
+        dirtyVRAM[address >> DIRTY_PAGE_SHIFT] = 1;
 
 #ifdef BKPT_SUPPORT
         if (*((uint32_t*)&freezeVRAM[address]))
@@ -567,6 +588,7 @@ static inline void CPUWriteHalfWord(uint32_t address, uint16_t value)
 
     switch (address >> 24) {
     case 2:
+        dirtyWorkRAM[(address & 0x3FFFE) >> DIRTY_PAGE_SHIFT] = 1;
 #ifdef BKPT_SUPPORT
         if (*((uint16_t*)&freezeWorkRAM[address & 0x3FFFE]))
             cheatsWriteHalfWord(address & 0x203FFFE, value);
@@ -575,6 +597,7 @@ static inline void CPUWriteHalfWord(uint32_t address, uint16_t value)
             WRITE16LE(((uint16_t*)&workRAM[address & 0x3FFFE]), value);
         break;
     case 3:
+        dirtyInternalRAM[(address & 0x7ffe) >> DIRTY_PAGE_SHIFT] = 1;
 #ifdef BKPT_SUPPORT
         if (*((uint16_t*)&freezeInternalRAM[address & 0x7ffe]))
             cheatsWriteHalfWord(address & 0x3007ffe, value);
@@ -602,6 +625,7 @@ static inline void CPUWriteHalfWord(uint32_t address, uint16_t value)
             return;
         if ((address & 0x18000) == 0x18000)
             address &= 0x17fff;
+        dirtyVRAM[address >> DIRTY_PAGE_SHIFT] = 1;
 #ifdef BKPT_SUPPORT
         if (*((uint16_t*)&freezeVRAM[address]))
             cheatsWriteHalfWord(address + 0x06000000, value);
@@ -665,6 +689,7 @@ static inline void CPUWriteByte(uint32_t address, uint8_t b)
 
     switch (address >> 24) {
     case 2:
+        dirtyWorkRAM[(address & 0x3FFFF) >> DIRTY_PAGE_SHIFT] = 1;
 #ifdef BKPT_SUPPORT
         if (freezeWorkRAM[address & 0x3FFFF])
             cheatsWriteByte(address & 0x203FFFF, b);
@@ -673,6 +698,7 @@ static inline void CPUWriteByte(uint32_t address, uint8_t b)
             workRAM[address & 0x3FFFF] = b;
         break;
     case 3:
+        dirtyInternalRAM[(address & 0x7fff) >> DIRTY_PAGE_SHIFT] = 1;
 #ifdef BKPT_SUPPORT
         if (freezeInternalRAM[address & 0x7fff])
             cheatsWriteByte(address & 0x3007fff, b);
@@ -760,6 +786,7 @@ static inline void CPUWriteByte(uint32_t address, uint8_t b)
         // no need to switch
         // byte writes to OBJ VRAM are ignored
         if ((address) < objTilesAddress[((DISPCNT & 7) + 1) >> 2]) {
+            dirtyVRAM[address >> DIRTY_PAGE_SHIFT] = 1;
 #ifdef BKPT_SUPPORT
             if (freezeVRAM[address])
                 cheatsWriteByte(address + 0x06000000, b);
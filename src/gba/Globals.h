@@ -15,112 +15,119 @@
 #define VERBOSE_AGBPRINT 512
 #define VERBOSE_SOUNDOUTPUT 1024
 
-extern reg_pair reg[45];
-extern bool ioReadable[0x400];
-extern bool N_FLAG;
-extern bool C_FLAG;
-extern bool Z_FLAG;
-extern bool V_FLAG;
-extern bool armState;
-extern bool armIrqEnable;
-extern uint32_t armNextPC;
-extern int armMode;
-extern uint32_t stop;
-extern int saveType;
+extern THREAD_STATE reg_pair reg[45];
+extern THREAD_STATE bool ioReadable[0x400];
+extern THREAD_STATE bool N_FLAG;
+extern THREAD_STATE bool C_FLAG;
+extern THREAD_STATE bool Z_FLAG;
+extern THREAD_STATE bool V_FLAG;
+extern THREAD_STATE bool armState;
+extern THREAD_STATE bool armIrqEnable;
+extern THREAD_STATE uint32_t armNextPC;
+extern THREAD_STATE int armMode;
+extern THREAD_STATE uint32_t stop;
+extern THREAD_STATE int saveType;
 extern int frameSkip;
 extern bool gba_joybus_enabled;
 extern bool gba_joybus_active;
-extern int layerSettings;
-extern int layerEnable;
-extern int cpuSaveType;
-extern int customBackdropColor;
+extern THREAD_STATE int layerSettings;
+extern THREAD_STATE int layerEnable;
+extern THREAD_STATE int cpuSaveType;
+extern THREAD_STATE int customBackdropColor;
 
-extern uint8_t* bios;
-extern uint8_t* rom;
-extern uint8_t* internalRAM;
-extern uint8_t* workRAM;
-extern uint8_t* paletteRAM;
-extern uint8_t* vram;
-extern uint8_t* pix;
-extern uint8_t* oam;
-extern uint8_t* ioMem;
+extern THREAD_STATE uint8_t* bios;
+extern THREAD_STATE uint8_t* rom;
+extern THREAD_STATE uint8_t* internalRAM;
+extern THREAD_STATE uint8_t* workRAM;
+extern THREAD_STATE uint8_t* paletteRAM;
+extern THREAD_STATE uint8_t* vram;
+extern THREAD_STATE uint8_t* pix;
+extern THREAD_STATE uint8_t* oam;
+extern THREAD_STATE uint8_t* ioMem;
 
-extern uint16_t DISPCNT;
-extern uint16_t DISPSTAT;
-extern uint16_t VCOUNT;
-extern uint16_t BG0CNT;
-extern uint16_t BG1CNT;
-extern uint16_t BG2CNT;
-extern uint16_t BG3CNT;
-extern uint16_t BG0HOFS;
-extern uint16_t BG0VOFS;
-extern uint16_t BG1HOFS;
-extern uint16_t BG1VOFS;
-extern uint16_t BG2HOFS;
-extern uint16_t BG2VOFS;
-extern uint16_t BG3HOFS;
-extern uint16_t BG3VOFS;
-extern uint16_t BG2PA;
-extern uint16_t BG2PB;
-extern uint16_t BG2PC;
-extern uint16_t BG2PD;
-extern uint16_t BG2X_L;
-extern uint16_t BG2X_H;
-extern uint16_t BG2Y_L;
-extern uint16_t BG2Y_H;
-extern uint16_t BG3PA;
-extern uint16_t BG3PB;
-extern uint16_t BG3PC;
-extern uint16_t BG3PD;
-extern uint16_t BG3X_L;
-extern uint16_t BG3X_H;
-extern uint16_t BG3Y_L;
-extern uint16_t BG3Y_H;
-extern uint16_t WIN0H;
-extern uint16_t WIN1H;
-extern uint16_t WIN0V;
-extern uint16_t WIN1V;
-extern uint16_t WININ;
-extern uint16_t WINOUT;
-extern uint16_t MOSAIC;
-extern uint16_t BLDMOD;
-extern uint16_t COLEV;
-extern uint16_t COLY;
-extern uint16_t DM0SAD_L;
-extern uint16_t DM0SAD_H;
-extern uint16_t DM0DAD_L;
-extern uint16_t DM0DAD_H;
-extern uint16_t DM0CNT_L;
-extern uint16_t DM0CNT_H;
-extern uint16_t DM1SAD_L;
-extern uint16_t DM1SAD_H;
-extern uint16_t DM1DAD_L;
-extern uint16_t DM1DAD_H;
-extern uint16_t DM1CNT_L;
-extern uint16_t DM1CNT_H;
-extern uint16_t DM2SAD_L;
-extern uint16_t DM2SAD_H;
-extern uint16_t DM2DAD_L;
-extern uint16_t DM2DAD_H;
-extern uint16_t DM2CNT_L;
-extern uint16_t DM2CNT_H;
-extern uint16_t DM3SAD_L;
-extern uint16_t DM3SAD_H;
-extern uint16_t DM3DAD_L;
-extern uint16_t DM3DAD_H;
-extern uint16_t DM3CNT_L;
-extern uint16_t DM3CNT_H;
-extern uint16_t TM0D;
-extern uint16_t TM0CNT;
-extern uint16_t TM1D;
-extern uint16_t TM1CNT;
-extern uint16_t TM2D;
-extern uint16_t TM2CNT;
-extern uint16_t TM3D;
-extern uint16_t TM3CNT;
-extern uint16_t P1;
-extern uint16_t IE;
-extern uint16_t IF;
-extern uint16_t IME;
+// One flag per 4 KB page stored to since the last incremental raw state
+// (CPUWriteRawStateDirty). Palette and OAM are 1 KB, always copied whole.
+#define DIRTY_PAGE_SHIFT 12
+extern THREAD_STATE uint8_t dirtyInternalRAM[0x8000 >> DIRTY_PAGE_SHIFT];
+extern THREAD_STATE uint8_t dirtyWorkRAM[WORK_RAM_SIZE >> DIRTY_PAGE_SHIFT];
+extern THREAD_STATE uint8_t dirtyVRAM[0x20000 >> DIRTY_PAGE_SHIFT];
+
+extern THREAD_STATE uint16_t DISPCNT;
+extern THREAD_STATE uint16_t DISPSTAT;
+extern THREAD_STATE uint16_t VCOUNT;
+extern THREAD_STATE uint16_t BG0CNT;
+extern THREAD_STATE uint16_t BG1CNT;
+extern THREAD_STATE uint16_t BG2CNT;
+extern THREAD_STATE uint16_t BG3CNT;
+extern THREAD_STATE uint16_t BG0HOFS;
+extern THREAD_STATE uint16_t BG0VOFS;
+extern THREAD_STATE uint16_t BG1HOFS;
+extern THREAD_STATE uint16_t BG1VOFS;
+extern THREAD_STATE uint16_t BG2HOFS;
+extern THREAD_STATE uint16_t BG2VOFS;
+extern THREAD_STATE uint16_t BG3HOFS;
+extern THREAD_STATE uint16_t BG3VOFS;
+extern THREAD_STATE uint16_t BG2PA;
+extern THREAD_STATE uint16_t BG2PB;
+extern THREAD_STATE uint16_t BG2PC;
+extern THREAD_STATE uint16_t BG2PD;
+extern THREAD_STATE uint16_t BG2X_L;
+extern THREAD_STATE uint16_t BG2X_H;
+extern THREAD_STATE uint16_t BG2Y_L;
+extern THREAD_STATE uint16_t BG2Y_H;
+extern THREAD_STATE uint16_t BG3PA;
+extern THREAD_STATE uint16_t BG3PB;
+extern THREAD_STATE uint16_t BG3PC;
+extern THREAD_STATE uint16_t BG3PD;
+extern THREAD_STATE uint16_t BG3X_L;
+extern THREAD_STATE uint16_t BG3X_H;
+extern THREAD_STATE uint16_t BG3Y_L;
+extern THREAD_STATE uint16_t BG3Y_H;
+extern THREAD_STATE uint16_t WIN0H;
+extern THREAD_STATE uint16_t WIN1H;
+extern THREAD_STATE uint16_t WIN0V;
+extern THREAD_STATE uint16_t WIN1V;
+extern THREAD_STATE uint16_t WININ;
+extern THREAD_STATE uint16_t WINOUT;
+extern THREAD_STATE uint16_t MOSAIC;
+extern THREAD_STATE uint16_t BLDMOD;
+extern THREAD_STATE uint16_t COLEV;
+extern THREAD_STATE uint16_t COLY;
+extern THREAD_STATE uint16_t DM0SAD_L;
+extern THREAD_STATE uint16_t DM0SAD_H;
+extern THREAD_STATE uint16_t DM0DAD_L;
+extern THREAD_STATE uint16_t DM0DAD_H;
+extern THREAD_STATE uint16_t DM0CNT_L;
+extern THREAD_STATE uint16_t DM0CNT_H;
+extern THREAD_STATE uint16_t DM1SAD_L;
+extern THREAD_STATE uint16_t DM1SAD_H;
+extern THREAD_STATE uint16_t DM1DAD_L;
+extern THREAD_STATE uint16_t DM1DAD_H;
+extern THREAD_STATE uint16_t DM1CNT_L;
+extern THREAD_STATE uint16_t DM1CNT_H;
+extern THREAD_STATE uint16_t DM2SAD_L;
+extern THREAD_STATE uint16_t DM2SAD_H;
+extern THREAD_STATE uint16_t DM2DAD_L;
+extern THREAD_STATE uint16_t DM2DAD_H;
+extern THREAD_STATE uint16_t DM2CNT_L;
+extern THREAD_STATE uint16_t DM2CNT_H;
+extern THREAD_STATE uint16_t DM3SAD_L;
+extern THREAD_STATE uint16_t DM3SAD_H;
+extern THREAD_STATE uint16_t DM3DAD_L;
+extern THREAD_STATE uint16_t DM3DAD_H;
+extern THREAD_STATE uint16_t DM3CNT_L;
+extern THREAD_STATE uint16_t DM3CNT_H;
+extern THREAD_STATE uint16_t TM0D;
+extern THREAD_STATE uint16_t TM0CNT;
+extern THREAD_STATE uint16_t TM1D;
+extern THREAD_STATE uint16_t TM1CNT;
+extern THREAD_STATE uint16_t TM2D;
+extern THREAD_STATE uint16_t TM2CNT;
+extern THREAD_STATE uint16_t TM3D;
+extern THREAD_STATE uint16_t TM3CNT;
+extern THREAD_STATE uint16_t P1;
+extern THREAD_STATE uint16_t IE;
+extern THREAD_STATE uint16_t IF;
+extern THREAD_STATE uint16_t IME;
 
 #endif // GLOBALS_H
@@ -0,0 +1,272 @@
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "../NLS.h"
+#include "../System.h"
+#include "../Util.h"
+#include "EEprom.h"
+#include "Flash.h"
+#include "GBA.h"
+#include "Globals.h"
+#include "Movie.h"
+
+#define MOVIE_MAGIC 0x564d5456 // "VTMV"
+#define MOVIE_VERSION 2
+
+// After the header, a record per run of frames: the keys in the low bits
+// and the number of frames in the high half. A checkpoint record is
+// followed by the checksum of the frame it is at.
+#define MOVIE_KEYS 0x3ff
+#define MOVIE_CHECKPOINT 0x8000
+#define MOVIE_RUN_MAX 0xffff
+
+static THREAD_STATE struct {
+    gzFile file;
+    bool recording;
+    bool playing;
+    int frame;
+    uint32_t keys; // of the run being recorded or played
+    int run; // frames in it so far while recording, left while playing
+    int desyncFrame;
+} movie = { NULL, false, false, 0, 0, 0, -1 };
+
+// What playback has to find the same again
+static uint32_t movieChecksum()
+{
+    uLong crc = crc32(0L, Z_NULL, 0);
+
+    crc = crc32(crc, (const Bytef*)&reg[0], sizeof(reg));
+    crc = crc32(crc, internalRAM, 0x8000);
+    crc = crc32(crc, workRAM, WORK_RAM_SIZE);
+    crc = crc32(crc, ioMem, 0x400);
+    return (uint32_t)crc;
+}
+
+// A movie from power-on carries the save chips, whatever the game is
+// using: it reads them before anything the movie has input
+static void movieWriteSave(gzFile gzFile)
+{
+    utilWriteInt(gzFile, flashSize);
+    utilGzWrite(gzFile, flashSaveMemory, sizeof(flashSaveMemory));
+    utilWriteInt(gzFile, eepromSize);
+    utilGzWrite(gzFile, eepromData, sizeof(eepromData));
+}
+
+static bool movieReadSave(gzFile gzFile)
+{
+    int size = utilReadInt(gzFile);
+    if (size != 0x10000 && size != 0x20000)
+        return false;
+    if (utilGzRead(gzFile, flashSaveMemory, sizeof(flashSaveMemory)) != (int)sizeof(flashSaveMemory))
+        return false;
+    flashSize = size;
+    flashSetSize(size);
+
+    size = utilReadInt(gzFile);
+    if (size != 512 && size != 0x2000)
+        return false;
+    if (utilGzRead(gzFile, eepromData, sizeof(eepromData)) != (int)sizeof(eepromData))
+        return false;
+    eepromSize = size;
+    return true;
+}
+
+static bool movieReadRecord(uint32_t& record)
+{
+    return utilGzRead(movie.file, &record, sizeof record) == sizeof record;
+}
+
+static void movieEndRun()
+{
+    if (movie.run)
+        utilWriteInt(movie.file, movie.keys | (movie.run << 16));
+    movie.run = 0;
+}
+
+static void movieStart(gzFile file, bool recording)
+{
+    movie.file = file;
+    movie.recording = recording;
+    movie.playing = !recording;
+    movie.frame = 0;
+    movie.keys = 0;
+    movie.run = 0;
+    movie.desyncFrame = -1;
+}
+
+bool movieRecord(const char* file, bool fromState)
+{
+    movieStop();
+
+    uint8_t* state = NULL;
+    unsigned size = 0;
+    if (fromState) {
+        size = CPURawStateSize();
+        state = (uint8_t*)malloc(size);
+        if (!state || !(size = CPUWriteRawState(state, size))) {
+            free(state);
+            return false;
+        }
+    }
+
+    gzFile gzFile = utilGzOpen(file, "wb");
+
+    if (gzFile == NULL) {
+        systemMessage(MSG_ERROR_CREATING_FILE, N_("Error creating file %s"), file);
+        free(state);
+        return false;
+    }
+
+    utilWriteInt(gzFile, MOVIE_MAGIC);
+    utilWriteInt(gzFile, MOVIE_VERSION);
+    utilGzWrite(gzFile, &rom[0xa0], 16);
+    utilWriteInt(gzFile, size);
+    if (state)
+        utilGzWrite(gzFile, state, size);
+    else
+        movieWriteSave(gzFile);
+    free(state);
+
+    if (!fromState)
+        CPUReset();
+
+    movieStart(gzFile, true);
+    return true;
+}
+
+bool moviePlay(const char* file)
+{
+    movieStop();
+
+    gzFile gzFile = utilGzOpen(file, "rb");
+
+    if (gzFile == NULL) {
+        systemMessage(MSG_CANNOT_OPEN_FILE, N_("Cannot open file %s"), file);
+        return false;
+    }
+
+    if (utilReadInt(gzFile) != MOVIE_MAGIC || utilReadInt(gzFile) != MOVIE_VERSION) {
+        systemMessage(MSG_CANNOT_OPEN_FILE, N_("Unsupported movie %s"), file);
+        utilGzClose(gzFile);
+        return false;
+    }
+
+    uint8_t romname[17];
+
+    utilGzRead(gzFile, romname, 16);
+
+    if (memcmp(&rom[0xa0], romname, 16) != 0) {
+        romname[16] = 0;
+        for (int i = 0; i < 16; i++)
+            if (romname[i] < 32)
+                romname[i] = 32;
+        systemMessage(MSG_CANNOT_OPEN_FILE, N_("Movie is for %s"), romname);
+        utilGzClose(gzFile);
+        return false;
+    }
+
+    unsigned size = utilReadInt(gzFile);
+    if (size) {
+        uint8_t* state = (uint8_t*)malloc(size);
+        bool loaded = state
+            && utilGzRead(gzFile, state, size) == (int)size
+            && CPUReadRawState(state, size);
+        free(state);
+        if (!loaded) {
+            systemMessage(MSG_CANNOT_OPEN_FILE, N_("Cannot load the savestate of movie %s"), file);
+            utilGzClose(gzFile);
+            return false;
+        }
+    } else {
+        if (!movieReadSave(gzFile)) {
+            systemMessage(MSG_CANNOT_OPEN_FILE, N_("Cannot load the save of movie %s"), file);
+            utilGzClose(gzFile);
+            return false;
+        }
+        CPUReset();
+    }
+
+    movieStart(gzFile, false);
+    return true;
+}
+
+void movieStop()
+{
+    if (!movie.file)
+        return;
+
+    if (movie.recording)
+        movieEndRun();
+    utilGzClose(movie.file);
+    movie.file = NULL;
+    movie.recording = false;
+    movie.playing = false;
+}
+
+bool movieRecording()
+{
+    return movie.recording;
+}
+
+bool moviePlaying()
+{
+    return movie.playing;
+}
+
+int movieFrame()
+{
+    return movie.frame;
+}
+
+int movieDesyncFrame()
+{
+    return movie.desyncFrame;
+}
+
+uint32_t movieUpdateJoypad(uint32_t joy)
+{
+    if (movie.recording) {
+        uint32_t keys = joy & MOVIE_KEYS;
+
+        if (movie.frame && movie.frame % MOVIE_CHECK_FRAMES == 0) {
+            movieEndRun();
+            utilWriteInt(movie.file, MOVIE_CHECKPOINT);
+            utilWriteInt(movie.file, movieChecksum());
+        }
+        if (keys != movie.keys || movie.run == MOVIE_RUN_MAX)
+            movieEndRun();
+        movie.keys = keys;
+        movie.run++;
+        movie.frame++;
+        return joy;
+    }
+
+    if (!movie.playing)
+        return joy;
+
+    uint32_t record;
+    while (!movie.run) {
+        if (!movieReadRecord(record)) {
+            // the end, the frontend has the pad again
+            movieStop();
+            systemScreenMessage("Movie ended");
+            return joy;
+        }
+        if (record == MOVIE_CHECKPOINT) {
+            if (!movieReadRecord(record))
+                continue;
+            if (record != movieChecksum() && movie.desyncFrame < 0) {
+                movie.desyncFrame = movie.frame;
+                systemMessage(0, N_("Movie desynced at frame %d"), movie.frame);
+            }
+            continue;
+        }
+        movie.keys = record & MOVIE_KEYS;
+        movie.run = record >> 16;
+    }
+
+    movie.run--;
+    movie.frame++;
+    return (joy & ~MOVIE_KEYS) | movie.keys;
+}
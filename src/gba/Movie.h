@@ -0,0 +1,34 @@
+#ifndef MOVIE_H
+#define MOVIE_H
+
+// Input movies: the pad as the game latched it on every frame, from
+// power-on or from a savestate, so a run can be played back exactly. The
+// keys are stored as runs of frames holding the same ones, with a
+// checksum of memory and registers every MOVIE_CHECK_FRAMES frames that
+// playback compares to tell it went the same way.
+//
+// A movie from power-on keeps the battery save it was recorded with and
+// puts it back for playback. Games reading the RTC see the time they are
+// played back at.
+
+#define MOVIE_CHECK_FRAMES 300
+
+// Starts recording to file, from the current state or after resetting
+bool movieRecord(const char* file, bool fromState);
+// Loads the movie's savestate or resets, then plays it back
+bool moviePlay(const char* file);
+// Stops recording or playback. A recording is closed off, ready to play.
+void movieStop();
+
+bool movieRecording();
+bool moviePlaying();
+// Frames recorded or played back so far
+int movieFrame();
+// The first checkpoint playback didn't match, -1 while in sync
+int movieDesyncFrame();
+
+// For CPULoop, latching the pad from the frontend: records the keys, or
+// replaces them with the movie's while it plays
+uint32_t movieUpdateJoypad(uint32_t joy);
+
+#endif // MOVIE_H
@@ -9,7 +9,7 @@
 #include <string.h>
 #include <time.h>
 
-extern int rtcEnabled;
+extern THREAD_STATE int rtcEnabled;
 
 enum RTCSTATE {
     IDLE = 0,
@@ -34,12 +34,12 @@ typedef struct
     uint32_t reserved3;
 } RTCCLOCKDATA;
 
-struct tm gba_time;
-static RTCCLOCKDATA rtcClockData;
-static bool rtcClockEnabled = true;
-static bool rtcRumbleEnabled = false;
+THREAD_STATE struct tm gba_time;
+static THREAD_STATE RTCCLOCKDATA rtcClockData;
+static THREAD_STATE bool rtcClockEnabled = true;
+static THREAD_STATE bool rtcRumbleEnabled = false;
 
-uint32_t countTicks = 0;
+THREAD_STATE uint32_t countTicks = 0;
 
 void rtcEnable(bool e)
 {
@@ -308,17 +308,22 @@ void rtcReset()
     SetGBATime();
 }
 
-#ifdef __LIBRETRO__
 void rtcSaveGame(uint8_t*& data)
 {
     utilWriteMem(data, &rtcClockData, sizeof(rtcClockData));
 }
 
+unsigned rtcSaveGameSize()
+{
+    return sizeof(rtcClockData);
+}
+
 void rtcReadGame(const uint8_t*& data)
 {
     utilReadMem(&rtcClockData, data, sizeof(rtcClockData));
 }
-#else
+
+#ifndef __LIBRETRO__
 void rtcSaveGame(gzFile gzFile)
 {
     utilGzWrite(gzFile, &rtcClockData, sizeof(rtcClockData));
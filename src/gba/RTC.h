@@ -9,10 +9,10 @@ void rtcEnableRumble(bool e);
 bool rtcIsEnabled();
 void rtcReset();
 
-#ifdef __LIBRETRO__
 void rtcReadGame(const uint8_t*& data);
 void rtcSaveGame(uint8_t*& data);
-#else
+unsigned rtcSaveGameSize();
+#ifndef __LIBRETRO__
 void rtcReadGame(gzFile gzFile);
 void rtcSaveGame(gzFile gzFile);
 #endif
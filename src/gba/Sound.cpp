@@ -1,3 +1,4 @@
+#include <stdlib.h>
 #include <string.h>
 
 #include "Sound.h"
@@ -11,6 +12,7 @@
 #include "../apu/Multi_Buffer.h"
 
 #include "../common/SoundDriver.h"
+#include "../common/spscqueue.h"
 
 #define NR10 0x60
 #define NR11 0x62
@@ -34,33 +36,26 @@
 #define NR51 0x81
 #define NR52 0x84
 
-SoundDriver* soundDriver = 0;
-
-extern bool stopState; // TODO: silence sound when true
+extern THREAD_STATE bool stopState; // TODO: silence sound when true
 
 int const SOUND_CLOCK_TICKS_ = 167772; // 1/100 second
 
-static uint16_t soundFinalWave[1600];
 long soundSampleRate = 44100;
 bool soundInterpolation = true;
-bool soundPaused = true;
 float soundFiltering = 0.5f;
-int SOUND_CLOCK_TICKS = SOUND_CLOCK_TICKS_;
-int soundTicks = SOUND_CLOCK_TICKS_;
-
-static float soundVolume = 1.0f;
-static int soundEnableFlag = 0x3ff; // emulator channels enabled
-static float soundFiltering_ = -1;
-static float soundVolume_ = -1;
+THREAD_STATE int SOUND_CLOCK_TICKS = SOUND_CLOCK_TICKS_;
+THREAD_STATE int soundTicks = SOUND_CLOCK_TICKS_;
 
 void interp_rate() { /* empty for now */}
 
 class Gba_Pcm {
 public:
     void init();
-    void apply_control(int idx);
-    void update(int dac);
+    void apply_control(int ch, int shift, blip_time_t time);
+    void update(blip_time_t time, int dac);
     void end_frame(blip_time_t);
+    // Drops the output without the step back to silence apply_control() adds
+    void detach() { output = 0; }
 
 private:
     Blip_Buffer* output;
@@ -77,6 +72,16 @@ public:
     void write_control(int data);
     void write_fifo(int data);
     void timer_overflowed(int which_timer);
+    void apply_control(bool update);
+    void detach()
+    {
+        routed = false;
+        pcm.detach();
+    }
+
+    // Turns queued samples into blip deltas
+    void flush();
+    void discard_queue() { queued = 0; }
 
     // public only so save state routines can access it
     int readIndex;
@@ -88,13 +93,124 @@ public:
 private:
     int timer;
     bool enabled;
+    bool routed; // pcm has an output buffer
+
+    // Samples read on timer overflow, waiting to be handed to the synth
+    enum { queue_size = 512 };
+    int queued;
+    blip_time_t queue_time[queue_size];
+    int8_t queue_dac[queue_size];
+};
+
+// Threaded synthesis. The emulation thread only logs what would have been
+// done to the APU and PCM synths; soundThreadProcess() replays it in order.
+enum {
+    log_apu_write,
+    log_apu_volume,
+    log_pcm_route,
+    log_pcm_control,
+    log_pcm_sample,
+    log_end_frame
+};
+
+struct Sound_Log_Entry {
+    int type;
+    blip_time_t time;
+    int arg;
+    int data;
+};
+
+// One GBA's sound: the emulated hardware, the synths and the driver they
+// play to. The thread emulating it reaches it through snd; with threaded
+// synthesis the sound thread is handed the same one by soundSetContext().
+struct Gba_Sound {
+    Gba_Sound();
+
+    SoundDriver* soundDriver;
+    bool soundPaused;
+    uint16_t soundFinalWave[1600];
+
+    float soundVolume;
+    int soundEnableFlag; // emulator channels enabled
+    float soundFiltering_;
+    float soundVolume_;
+    bool soundTimingOnly; // forced by frontend
+    bool soundCapture; // frontend wants samples even without a driver
+    bool soundSynthesis; // true if samples are being generated
+    bool soundThreaded; // synthesis replayed by soundThreadProcess()
+    int decimation; // one frame's samples of every that many go to the driver
+    int decimated; // frames since the last that did
+
+    Gba_Pcm_Fifo pcm[2];
+    Gb_Apu* gb_apu;
+    Stereo_Buffer* stereo_buffer;
+
+    Blip_Synth<blip_best_quality, 1> pcm_synth[3]; // 32 kHz, 16 kHz, 8 kHz
+    int apu_volume_level; // SGCNT0_H & 3, as last seen by the synth side
+
+    // Everything soundRunAheadEnd() puts back. The FIFOs are plain values,
+    // their output included, and the APU has a snapshot of its own.
+    struct {
+        bool saved;
+        gb_apu_snapshot_t apu;
+        Gba_Pcm_Fifo pcm[2];
+        int ticks;
+        int apu_volume_level;
+        bool synthesis;
+        bool timing_only;
+    } run_ahead;
+
+    SpscQueue<Sound_Log_Entry> sound_log;
 };
 
-static Gba_Pcm_Fifo pcm[2];
-static Gb_Apu* gb_apu;
-static Stereo_Buffer* stereo_buffer;
+Gba_Sound::Gba_Sound()
+    : soundDriver(0)
+    , soundPaused(true)
+    , soundVolume(1.0f)
+    , soundEnableFlag(0x3ff)
+    , soundFiltering_(-1)
+    , soundVolume_(-1)
+    , soundTimingOnly(false)
+    , soundCapture(false)
+    , soundSynthesis(false)
+    , soundThreaded(false)
+    , decimation(1)
+    , decimated(0)
+    , gb_apu(0)
+    , stereo_buffer(0)
+    , apu_volume_level(0)
+{
+    run_ahead.saved = false;
+}
+
+static THREAD_STATE_INIT Gba_Sound sound_own;
+static THREAD_STATE_INIT Gba_Sound* snd = &sound_own;
 
-static Blip_Synth<blip_best_quality, 1> pcm_synth[3]; // 32 kHz, 16 kHz, 8 kHz
+Gba_Sound* soundGetContext()
+{
+    return snd;
+}
+
+void soundSetContext(Gba_Sound* context)
+{
+    snd = context ? context : &sound_own;
+}
+
+static void log_event(int type, blip_time_t time, int arg, int data)
+{
+    Sound_Log_Entry e;
+    e.type = type;
+    e.time = time;
+    e.arg = arg;
+    e.data = data;
+
+    // Full means the synth side is behind (usually blocked on the sound
+    // driver), so wait for it like a non-threaded driver write would.
+    while (!snd->sound_log.push(e)) {
+        systemSoundThreadNotify();
+        systemSoundThreadWait();
+    }
+}
 
 static inline blip_time_t blip_time()
 {
@@ -109,31 +225,27 @@ void Gba_Pcm::init()
     shift = 0;
 }
 
-void Gba_Pcm::apply_control(int idx)
+void Gba_Pcm::apply_control(int ch, int shift_, blip_time_t time)
 {
-    shift = ~ioMem[SGCNT0_H] >> (2 + idx) & 1;
-
-    int ch = 0;
-    if ((soundEnableFlag >> idx & 0x100) && (ioMem[NR52] & 0x80))
-        ch = ioMem[SGCNT0_H + 1] >> (idx * 4) & 3;
+    shift = shift_;
 
     Blip_Buffer* out = 0;
     switch (ch) {
     case 1:
-        out = stereo_buffer->right();
+        out = snd->stereo_buffer->right();
         break;
     case 2:
-        out = stereo_buffer->left();
+        out = snd->stereo_buffer->left();
         break;
     case 3:
-        out = stereo_buffer->center();
+        out = snd->stereo_buffer->center();
         break;
     }
 
     if (output != out) {
         if (output) {
             output->set_modified();
-            pcm_synth[0].offset(blip_time(), -last_amp, output);
+            snd->pcm_synth[0].offset(time, -last_amp, output);
         }
         last_amp = 0;
         output = out;
@@ -150,11 +262,9 @@ void Gba_Pcm::end_frame(blip_time_t time)
         output->set_modified();
 }
 
-void Gba_Pcm::update(int dac)
+void Gba_Pcm::update(blip_time_t time, int dac)
 {
     if (output) {
-        blip_time_t time = blip_time();
-
         dac = (int8_t)dac >> shift;
         int delta_snd = dac - last_amp;
         if (delta_snd) {
@@ -173,7 +283,7 @@ void Gba_Pcm::update(int dac)
                 filter = filters[idx];
             }
 
-            pcm_synth[filter].offset(time, delta_snd, output);
+            snd->pcm_synth[filter].offset(time, delta_snd, output);
         }
         last_time = time;
     }
@@ -203,12 +313,52 @@ void Gba_Pcm_Fifo::timer_overflowed(int which_timer)
         count--;
         dac = fifo[readIndex];
         readIndex = (readIndex + 1) & 31;
-        pcm.update(dac);
+
+        if (routed) {
+            if (queued == queue_size)
+                flush();
+            queue_time[queued] = blip_time();
+            queue_dac[queued] = dac;
+            queued++;
+        }
+    }
+}
+
+void Gba_Pcm_Fifo::flush()
+{
+    if (snd->soundThreaded) {
+        for (int i = 0; i < queued; i++)
+            log_event(log_pcm_sample, queue_time[i], which, queue_dac[i]);
+    } else {
+        for (int i = 0; i < queued; i++)
+            pcm.update(queue_time[i], queue_dac[i]);
+    }
+    queued = 0;
+}
+
+void Gba_Pcm_Fifo::apply_control(bool update)
+{
+    int shift = ~ioMem[SGCNT0_H] >> (2 + which) & 1;
+
+    int ch = 0;
+    if (snd->soundSynthesis && (snd->soundEnableFlag >> which & 0x100) && (ioMem[NR52] & 0x80))
+        ch = ioMem[SGCNT0_H + 1] >> (which * 4) & 3;
+    routed = (ch != 0);
+
+    if (snd->soundThreaded) {
+        log_event(update ? log_pcm_control : log_pcm_route, blip_time(),
+            which | ch << 1 | shift << 3, dac);
+    } else {
+        pcm.apply_control(ch, shift, blip_time());
+        if (update)
+            pcm.update(blip_time(), dac);
     }
 }
 
 void Gba_Pcm_Fifo::write_control(int data)
 {
+    flush();
+
     enabled = (data & 0x0300) ? true : false;
     timer = (data & 0x0400) ? 1 : 0;
 
@@ -221,8 +371,7 @@ void Gba_Pcm_Fifo::write_control(int data)
         memset(fifo, 0, sizeof fifo);
     }
 
-    pcm.apply_control(which);
-    pcm.update(dac);
+    apply_control(true);
 }
 
 void Gba_Pcm_Fifo::write_fifo(int data)
@@ -235,8 +384,10 @@ void Gba_Pcm_Fifo::write_fifo(int data)
 
 static void apply_control()
 {
-    pcm[0].pcm.apply_control(0);
-    pcm[1].pcm.apply_control(1);
+    snd->pcm[0].flush();
+    snd->pcm[1].flush();
+    snd->pcm[0].apply_control(false);
+    snd->pcm[1].apply_control(false);
 }
 
 static int gba_to_gb_sound(int addr)
@@ -261,7 +412,10 @@ void soundEvent(uint32_t address, uint8_t data)
     int gb_addr = gba_to_gb_sound(address);
     if (gb_addr) {
         ioMem[address] = data;
-        gb_apu->write_register(blip_time(), gb_addr, data);
+        if (snd->soundThreaded)
+            log_event(log_apu_write, blip_time(), gb_addr, data);
+        else
+            snd->gb_apu->write_register(blip_time(), gb_addr, data);
 
         if (address == NR52)
             apply_control();
@@ -273,25 +427,31 @@ void soundEvent(uint32_t address, uint8_t data)
 static void apply_volume(bool apu_only = false)
 {
     if (!apu_only)
-        soundVolume_ = soundVolume;
+        snd->soundVolume_ = snd->soundVolume;
 
-    if (gb_apu) {
+    if (snd->gb_apu) {
         static float const apu_vols[4] = { 0.25, 0.5, 1, 0.25 };
-        gb_apu->volume(soundVolume_ * apu_vols[ioMem[SGCNT0_H] & 3]);
+        snd->gb_apu->volume(snd->soundVolume_ * apu_vols[snd->apu_volume_level]);
     }
 
     if (!apu_only) {
         for (int i = 0; i < 3; i++)
-            pcm_synth[i].volume(0.66 / 256 * soundVolume_);
+            snd->pcm_synth[i].volume(0.66 / 256 * snd->soundVolume_);
     }
 }
 
 static void write_SGCNT0_H(int data)
 {
     WRITE16LE(&ioMem[SGCNT0_H], data & 0x770F);
-    pcm[0].write_control(data);
-    pcm[1].write_control(data >> 4);
-    apply_volume(true);
+    snd->pcm[0].write_control(data);
+    snd->pcm[1].write_control(data >> 4);
+
+    if (snd->soundThreaded) {
+        log_event(log_apu_volume, blip_time(), 0, data & 3);
+    } else {
+        snd->apu_volume_level = data & 3;
+        apply_volume(true);
+    }
 }
 
 void soundEvent(uint32_t address, uint16_t data)
@@ -303,13 +463,13 @@ void soundEvent(uint32_t address, uint16_t data)
 
     case FIFOA_L:
     case FIFOA_H:
-        pcm[0].write_fifo(data);
+        snd->pcm[0].write_fifo(data);
         WRITE16LE(&ioMem[address], data);
         break;
 
     case FIFOB_L:
     case FIFOB_H:
-        pcm[1].write_fifo(data);
+        snd->pcm[1].write_fifo(data);
         WRITE16LE(&ioMem[address], data);
         break;
 
@@ -327,25 +487,26 @@ void soundEvent(uint32_t address, uint16_t data)
 
 void soundTimerOverflow(int timer)
 {
-    pcm[0].timer_overflowed(timer);
-    pcm[1].timer_overflowed(timer);
+    snd->pcm[0].timer_overflowed(timer);
+    snd->pcm[1].timer_overflowed(timer);
 }
 
 static void end_frame(blip_time_t time)
 {
-    pcm[0].pcm.end_frame(time);
-    pcm[1].pcm.end_frame(time);
+    snd->pcm[0].pcm.end_frame(time);
+    snd->pcm[1].pcm.end_frame(time);
 
-    gb_apu->end_frame(time);
-    stereo_buffer->end_frame(time);
+    snd->gb_apu->end_frame(time);
+    snd->stereo_buffer->end_frame(time);
 }
 
 void flush_samples(Multi_Buffer* buffer)
 {
 #ifdef __LIBRETRO__
-    int numSamples = buffer->read_samples((blip_sample_t*)soundFinalWave, buffer->samples_avail());
-    soundDriver->write(soundFinalWave, numSamples);
-    systemOnWriteDataToSoundBuffer(soundFinalWave, numSamples);
+    int numSamples = buffer->read_samples((blip_sample_t*)snd->soundFinalWave, buffer->samples_avail());
+    if (snd->soundDriver)
+        snd->soundDriver->write(snd->soundFinalWave, numSamples);
+    systemOnWriteDataToSoundBuffer(snd->soundFinalWave, numSamples);
 #else
     // We want to write the data frame by frame to support legacy audio drivers
     // that don't use the length parameter of the write method.
@@ -354,80 +515,194 @@ void flush_samples(Multi_Buffer* buffer)
     int soundBufferLen = (soundSampleRate / 60) * 4;
 
     // soundBufferLen should have a whole number of sample pairs
-    assert(soundBufferLen % (2 * sizeof *soundFinalWave) == 0);
+    assert(soundBufferLen % (2 * sizeof *snd->soundFinalWave) == 0);
 
     // number of samples in output buffer
-    int const out_buf_size = soundBufferLen / sizeof *soundFinalWave;
+    int const out_buf_size = soundBufferLen / sizeof *snd->soundFinalWave;
 
-    // Keep filling and writing soundFinalWave until it can't be fully filled
+    // Keep filling and writing snd->soundFinalWave until it can't be fully filled
     while (buffer->samples_avail() >= out_buf_size) {
-        buffer->read_samples((blip_sample_t*)soundFinalWave, out_buf_size);
-        if (soundPaused)
-            soundResume();
-
-        soundDriver->write(soundFinalWave, soundBufferLen);
-        systemOnWriteDataToSoundBuffer(soundFinalWave, soundBufferLen);
+        buffer->read_samples((blip_sample_t*)snd->soundFinalWave, out_buf_size);
+        if (snd->soundDriver) {
+            if (snd->soundPaused)
+                soundResume();
+
+            // The driver blocks while its buffer is full, which is the
+            // device's pace and no part of making the sound
+            if (++snd->decimated >= snd->decimation) {
+                snd->decimated = 0;
+                uint64_t timingStart = cpuTimingEnabled ? CPUTimingNow() : 0;
+                snd->soundDriver->write(snd->soundFinalWave, soundBufferLen);
+                if (cpuTimingEnabled) {
+                    uint64_t wait = CPUTimingNow() - timingStart;
+                    cpuTiming[TIMING_SOUND_WAIT] += wait;
+                    cpuTiming[TIMING_SOUND] -= wait;
+                }
+            }
+        }
+        systemOnWriteDataToSoundBuffer(snd->soundFinalWave, soundBufferLen);
     }
 #endif
 }
 
 static void apply_filtering()
 {
-    soundFiltering_ = soundFiltering;
+    snd->soundFiltering_ = soundFiltering;
 
-    int const base_freq = (int)(32768 - soundFiltering_ * 16384);
-    int const nyquist = stereo_buffer->sample_rate() / 2;
+    int const base_freq = (int)(32768 - snd->soundFiltering_ * 16384);
+    int const nyquist = snd->stereo_buffer->sample_rate() / 2;
 
     for (int i = 0; i < 3; i++) {
         int cutoff = base_freq >> i;
         if (cutoff > nyquist)
             cutoff = nyquist;
-        pcm_synth[i].treble_eq(blip_eq_t(0, 0, stereo_buffer->sample_rate(), cutoff));
+        snd->pcm_synth[i].treble_eq(blip_eq_t(0, 0, snd->stereo_buffer->sample_rate(), cutoff));
     }
 }
 
+// Synth side of psoundTickfn()
+static void run_frame(blip_time_t time, bool synthesis)
+{
+    if (!synthesis) {
+        // Timing only: keep the APU frame sequencer and PCM clocks
+        // moving, but nothing is mixed or sent to the driver.
+        snd->pcm[0].pcm.end_frame(time);
+        snd->pcm[1].pcm.end_frame(time);
+        snd->gb_apu->end_frame(time);
+        return;
+    }
+
+    // Run sound hardware to present
+    end_frame(time);
+
+    flush_samples(snd->stereo_buffer);
+
+    if (snd->soundFiltering_ != soundFiltering)
+        apply_filtering();
+
+    if (snd->soundVolume_ != snd->soundVolume)
+        apply_volume();
+}
+
 void psoundTickfn()
 {
-    if (gb_apu && stereo_buffer) {
-        // Run sound hardware to present
-        end_frame(SOUND_CLOCK_TICKS);
+    if (snd->gb_apu && snd->stereo_buffer) {
+        snd->pcm[0].flush();
+        snd->pcm[1].flush();
 
-        flush_samples(stereo_buffer);
+        if (snd->soundThreaded) {
+            log_event(log_end_frame, SOUND_CLOCK_TICKS, snd->soundSynthesis, 0);
+            systemSoundThreadNotify();
+        } else {
+            run_frame(SOUND_CLOCK_TICKS, snd->soundSynthesis);
+        }
+    }
+}
 
-        if (soundFiltering_ != soundFiltering)
-            apply_filtering();
+bool soundThreadProcess()
+{
+    if (snd->sound_log.empty())
+        return false;
+
+    do {
+        // Entry stays queued until done, so an empty log means the synth
+        // side is idle and the emulation thread may touch it directly
+        Sound_Log_Entry& e = snd->sound_log.front();
+        switch (e.type) {
+        case log_apu_write:
+            snd->gb_apu->write_register(e.time, e.arg, e.data);
+            break;
+
+        case log_apu_volume:
+            snd->apu_volume_level = e.data;
+            apply_volume(true);
+            break;
+
+        case log_pcm_route:
+        case log_pcm_control: {
+            Gba_Pcm& p = snd->pcm[e.arg & 1].pcm;
+            p.apply_control(e.arg >> 1 & 3, e.arg >> 3 & 1, e.time);
+            if (e.type == log_pcm_control)
+                p.update(e.time, e.data);
+            break;
+        }
+
+        case log_pcm_sample:
+            snd->pcm[e.arg].pcm.update(e.time, e.data);
+            break;
+
+        case log_end_frame:
+            run_frame(e.time, e.arg != 0);
+            break;
+        }
+        snd->sound_log.pop();
+    } while (!snd->sound_log.empty());
 
-        if (soundVolume_ != soundVolume)
-            apply_volume();
+    return true;
+}
+
+void soundThreadSync()
+{
+    while (!snd->sound_log.empty()) {
+        systemSoundThreadNotify();
+        systemSoundThreadWait();
+    }
+}
+
+void soundSetThreaded(bool threaded)
+{
+    soundThreadSync();
+
+    if (threaded && !snd->sound_log.size())
+        snd->sound_log.reset(4096);
+    snd->soundThreaded = threaded;
+}
+
+// Only points the oscillators at the buffers, or away from them
+static void route_apu()
+{
+    for (int i = 0; i < 4; i++) {
+        if (snd->soundSynthesis && (snd->soundEnableFlag >> i & 1))
+            snd->gb_apu->set_output(snd->stereo_buffer->center(),
+                snd->stereo_buffer->left(), snd->stereo_buffer->right(), i);
+        else
+            snd->gb_apu->set_output(0, 0, 0, i);
     }
 }
 
 static void apply_muting()
 {
-    if (!stereo_buffer || !ioMem)
+    if (!snd->stereo_buffer || !ioMem)
         return;
 
+    soundThreadSync();
+
+    // Synthesis is skipped entirely when nothing could be heard
+    bool synthesis = !snd->soundTimingOnly
+        && (snd->soundCapture || (snd->soundDriver && (snd->soundEnableFlag & 0x30f)));
+    if (synthesis && !snd->soundSynthesis) {
+        // Drop whatever was left over from before synthesis stopped
+        snd->stereo_buffer->clear();
+    }
+    snd->soundSynthesis = synthesis;
+
     // PCM
     apply_control();
 
-    if (gb_apu) {
-        // APU
-        for (int i = 0; i < 4; i++) {
-            if (soundEnableFlag >> i & 1)
-                gb_apu->set_output(stereo_buffer->center(),
-                    stereo_buffer->left(), stereo_buffer->right(), i);
-            else
-                gb_apu->set_output(0, 0, 0, i);
-        }
-    }
+    if (snd->gb_apu)
+        route_apu();
 }
 
 static void reset_apu()
 {
-    gb_apu->reset(gb_apu->mode_agb, true);
+    soundThreadSync();
+
+    snd->gb_apu->reset(snd->gb_apu->mode_agb, true);
 
-    if (stereo_buffer)
-        stereo_buffer->clear();
+    snd->pcm[0].discard_queue();
+    snd->pcm[1].discard_queue();
+    if (snd->stereo_buffer)
+        snd->stereo_buffer->clear();
 
     soundTicks = SOUND_CLOCK_TICKS;
 }
@@ -437,93 +712,187 @@ static void remake_stereo_buffer()
     if (!ioMem)
         return;
 
-    // Clears pointers kept to old stereo_buffer
-    pcm[0].pcm.init();
-    pcm[1].pcm.init();
+    soundThreadSync();
+
+    // Clears pointers kept to old snd->stereo_buffer
+    snd->pcm[0].discard_queue();
+    snd->pcm[1].discard_queue();
+    snd->pcm[0].pcm.init();
+    snd->pcm[1].pcm.init();
 
     // APU
-    if (!gb_apu) {
-        gb_apu = new Gb_Apu; // TODO: handle out of memory
+    if (!snd->gb_apu) {
+        snd->gb_apu = new Gb_Apu; // TODO: handle out of memory
         reset_apu();
     }
 
     // Stereo_Buffer
-    delete stereo_buffer;
-    stereo_buffer = 0;
+    delete snd->stereo_buffer;
+    snd->stereo_buffer = 0;
 
-    stereo_buffer = new Stereo_Buffer; // TODO: handle out of memory
-    stereo_buffer->set_sample_rate(soundSampleRate); // TODO: handle out of memory
-    stereo_buffer->clock_rate(gb_apu->clock_rate);
+    snd->stereo_buffer = new Stereo_Buffer; // TODO: handle out of memory
+    snd->stereo_buffer->set_sample_rate(soundSampleRate); // TODO: handle out of memory
+    snd->stereo_buffer->clock_rate(snd->gb_apu->clock_rate);
 
     // PCM
-    pcm[0].which = 0;
-    pcm[1].which = 1;
+    snd->pcm[0].which = 0;
+    snd->pcm[1].which = 1;
     apply_filtering();
 
     // Volume Level
+    snd->apu_volume_level = ioMem[SGCNT0_H] & 3;
     apply_muting();
     apply_volume();
 }
 
 void soundShutdown()
 {
-    if (soundDriver) {
-        delete soundDriver;
-        soundDriver = 0;
+    soundThreadSync();
+
+    if (snd->soundDriver) {
+        delete snd->soundDriver;
+        snd->soundDriver = 0;
     }
 
     systemOnSoundShutdown();
 
-    delete stereo_buffer;
-    stereo_buffer = 0;
+    snd->pcm[0].discard_queue();
+    snd->pcm[1].discard_queue();
+    delete snd->stereo_buffer;
+    snd->stereo_buffer = 0;
+
+    delete snd->gb_apu;
+    snd->gb_apu = 0;
 
-    delete gb_apu;
-    gb_apu = 0;
+    snd->run_ahead.saved = false;
+
+    snd->soundSynthesis = false;
 }
 
 void soundPause()
 {
-    soundPaused = true;
-    if (soundDriver)
-        soundDriver->pause();
+    snd->soundPaused = true;
+    if (snd->soundDriver)
+        snd->soundDriver->pause();
 }
 
 void soundResume()
 {
-    soundPaused = false;
-    if (soundDriver)
-        soundDriver->resume();
+    snd->soundPaused = false;
+    if (snd->soundDriver)
+        snd->soundDriver->resume();
 }
 
 void soundSetVolume(float volume)
 {
-    soundVolume = volume;
+    snd->soundVolume = volume;
 }
 
 float soundGetVolume()
 {
-    return soundVolume;
+    return snd->soundVolume;
 }
 
 void soundSetEnable(int channels)
 {
-    soundEnableFlag = channels;
+    snd->soundEnableFlag = channels;
     apply_muting();
 }
 
 int soundGetEnable()
 {
-    return (soundEnableFlag & 0x30f);
+    return (snd->soundEnableFlag & 0x30f);
+}
+
+void soundSetTimingOnly(bool timingOnly)
+{
+    snd->soundTimingOnly = timingOnly;
+    apply_muting();
+}
+
+bool soundGetTimingOnly()
+{
+    return !snd->soundSynthesis;
+}
+
+void soundSetDecimation(int every)
+{
+    if (every < 1)
+        every = 1;
+    if (every == snd->decimation)
+        return;
+
+    soundThreadSync();
+    snd->decimation = every;
+    snd->decimated = 0;
+}
+
+void soundRunAheadBegin()
+{
+    if (!snd->gb_apu || !snd->stereo_buffer)
+        return;
+
+    // Samples already read belong to the frame being kept
+    snd->pcm[0].flush();
+    snd->pcm[1].flush();
+    soundThreadSync();
+
+    snd->gb_apu->save_snapshot(&snd->run_ahead.apu);
+    snd->run_ahead.pcm[0] = snd->pcm[0];
+    snd->run_ahead.pcm[1] = snd->pcm[1];
+    snd->run_ahead.saved = true;
+    snd->run_ahead.ticks = soundTicks;
+    snd->run_ahead.apu_volume_level = snd->apu_volume_level;
+    snd->run_ahead.synthesis = snd->soundSynthesis;
+    snd->run_ahead.timing_only = snd->soundTimingOnly;
+
+    // Not through apply_muting() either: unrouting the PCM there steps its
+    // level back to zero in the kept frame's samples, which the restore
+    // can't take out again
+    snd->soundTimingOnly = true;
+    snd->soundSynthesis = false;
+    snd->pcm[0].detach();
+    snd->pcm[1].detach();
+    route_apu();
+}
+
+void soundRunAheadEnd()
+{
+    if (!snd->gb_apu || !snd->stereo_buffer || !snd->run_ahead.saved)
+        return;
+
+    soundThreadSync();
+
+    // Not through apply_muting(), turning synthesis back on from there
+    // would clear the samples the kept frame left in snd->stereo_buffer
+    snd->pcm[0] = snd->run_ahead.pcm[0];
+    snd->pcm[1] = snd->run_ahead.pcm[1];
+    soundTicks = snd->run_ahead.ticks;
+    snd->apu_volume_level = snd->run_ahead.apu_volume_level;
+    snd->soundSynthesis = snd->run_ahead.synthesis;
+    snd->soundTimingOnly = snd->run_ahead.timing_only;
+    snd->run_ahead.saved = false;
+
+    route_apu();
+    snd->gb_apu->load_snapshot(snd->run_ahead.apu);
+    apply_volume(true);
+}
+
+void soundSetCapture(bool capture)
+{
+    snd->soundCapture = capture;
+    apply_muting();
 }
 
 void soundReset()
 {
-    soundDriver->reset();
+    if (snd->soundDriver)
+        snd->soundDriver->reset();
 
     remake_stereo_buffer();
     reset_apu();
 
-    soundPaused = true;
+    snd->soundPaused = true;
     SOUND_CLOCK_TICKS = SOUND_CLOCK_TICKS_;
     soundTicks = SOUND_CLOCK_TICKS_;
 
@@ -532,22 +901,28 @@ void soundReset()
 
 bool soundInit()
 {
-    soundDriver = systemSoundInit();
-    if (!soundDriver)
+    snd->soundDriver = systemSoundInit();
+    if (!snd->soundDriver)
         return false;
 
-    if (!soundDriver->init(soundSampleRate))
+    if (!snd->soundDriver->init(soundSampleRate)) {
+        // No audio device, run timing only
+        delete snd->soundDriver;
+        snd->soundDriver = 0;
+        apply_muting();
         return false;
+    }
 
-    soundPaused = true;
+    snd->soundPaused = true;
+    apply_muting();
     return true;
 }
 
 void soundSetThrottle(unsigned short _throttle)
 {
-    if (!soundDriver)
+    if (!snd->soundDriver)
         return;
-    soundDriver->setThrottle(_throttle);
+    snd->soundDriver->setThrottle(_throttle);
 }
 
 long soundGetSampleRate()
@@ -570,7 +945,7 @@ void soundSetSampleRate(long sampleRate)
     }
 }
 
-static int dummy_state[16];
+static THREAD_STATE int dummy_state[16];
 
 #define SKIP(type, name)          \
     {                             \
@@ -582,7 +957,7 @@ static int dummy_state[16];
         &name, sizeof(type) \
     }
 
-static struct {
+static THREAD_STATE struct {
     gb_apu_state_t apu;
 
     // old state
@@ -591,8 +966,8 @@ static struct {
 } state;
 
 // Old GBA sound state format
-static variable_desc old_gba_state[] = {
-    SKIP(int, soundPaused),
+static THREAD_STATE_INIT variable_desc old_gba_state[] = {
+    SKIP(int, snd->soundPaused),
     SKIP(int, soundPlay),
     SKIP(int, soundTicks),
     SKIP(int, SOUND_CLOCK_TICKS),
@@ -645,30 +1020,30 @@ static variable_desc old_gba_state[] = {
     SKIP(int, sound4EnvelopeATL),
     SKIP(int, sound4EnvelopeATLReload),
     SKIP(int, sound4EnvelopeUpDown),
-    LOAD(int, soundEnableFlag),
+    LOAD(int, snd->soundEnableFlag),
     SKIP(int, soundControl),
-    LOAD(int, pcm[0].readIndex),
-    LOAD(int, pcm[0].count),
-    LOAD(int, pcm[0].writeIndex),
+    LOAD(int, snd->pcm[0].readIndex),
+    LOAD(int, snd->pcm[0].count),
+    LOAD(int, snd->pcm[0].writeIndex),
     SKIP(uint8_t, soundDSAEnabled), // was bool, which was one byte on MS compiler
     SKIP(int, soundDSATimer),
-    LOAD(uint8_t[32], pcm[0].fifo),
+    LOAD(uint8_t[32], snd->pcm[0].fifo),
     LOAD(uint8_t, state.soundDSAValue),
-    LOAD(int, pcm[1].readIndex),
-    LOAD(int, pcm[1].count),
-    LOAD(int, pcm[1].writeIndex),
+    LOAD(int, snd->pcm[1].readIndex),
+    LOAD(int, snd->pcm[1].count),
+    LOAD(int, snd->pcm[1].writeIndex),
     SKIP(int, soundDSBEnabled),
     SKIP(int, soundDSBTimer),
-    LOAD(uint8_t[32], pcm[1].fifo),
+    LOAD(uint8_t[32], snd->pcm[1].fifo),
     LOAD(int, state.soundDSBValue),
 
     // skipped manually
     //LOAD( int, soundBuffer[0][0], 6*735 },
-    //LOAD( int, soundFinalWave[0], 2*735 },
+    //LOAD( int, snd->soundFinalWave[0], 2*735 },
     { NULL, 0 }
 };
 
-variable_desc old_gba_state2[] = {
+THREAD_STATE_INIT variable_desc old_gba_state2[] = {
     LOAD(uint8_t[0x20], state.apu.regs[0x20]),
     SKIP(int, sound3Bank),
     SKIP(int, sound3DataSize),
@@ -677,21 +1052,21 @@ variable_desc old_gba_state2[] = {
 };
 
 // New state format
-static variable_desc gba_state[] = {
+static THREAD_STATE_INIT variable_desc gba_state[] = {
     // PCM
-    LOAD(int, pcm[0].readIndex),
-    LOAD(int, pcm[0].count),
-    LOAD(int, pcm[0].writeIndex),
-    LOAD(uint8_t[32], pcm[0].fifo),
-    LOAD(int, pcm[0].dac),
+    LOAD(int, snd->pcm[0].readIndex),
+    LOAD(int, snd->pcm[0].count),
+    LOAD(int, snd->pcm[0].writeIndex),
+    LOAD(uint8_t[32], snd->pcm[0].fifo),
+    LOAD(int, snd->pcm[0].dac),
 
     SKIP(int[4], room_for_expansion),
 
-    LOAD(int, pcm[1].readIndex),
-    LOAD(int, pcm[1].count),
-    LOAD(int, pcm[1].writeIndex),
-    LOAD(uint8_t[32], pcm[1].fifo),
-    LOAD(int, pcm[1].dac),
+    LOAD(int, snd->pcm[1].readIndex),
+    LOAD(int, snd->pcm[1].count),
+    LOAD(int, snd->pcm[1].writeIndex),
+    LOAD(uint8_t[32], snd->pcm[1].fifo),
+    LOAD(int, snd->pcm[1].dac),
 
     SKIP(int[4], room_for_expansion),
 
@@ -719,30 +1094,40 @@ static variable_desc gba_state[] = {
     SKIP(int[13], room_for_expansion),
 
     // Emulator
-    LOAD(int, soundEnableFlag),
+    LOAD(int, snd->soundEnableFlag),
 
     SKIP(int[15], room_for_expansion),
 
     { NULL, 0 }
 };
 
-#ifdef __LIBRETRO__
-void soundSaveGame(uint8_t*& out)
-#else
-void soundSaveGame(gzFile out)
-#endif
+static void begin_save_state()
 {
-    gb_apu->save_state(&state.apu);
+    soundThreadSync();
+    snd->gb_apu->save_state(&state.apu);
 
     // Be sure areas for expansion get written as zero
     memset(dummy_state, 0, sizeof dummy_state);
+}
 
-#ifdef __LIBRETRO__
+void soundSaveGame(uint8_t*& out)
+{
+    begin_save_state();
     utilWriteDataMem(out, gba_state);
-#else
+}
+
+unsigned soundSaveGameSize()
+{
+    return utilDataSize(gba_state);
+}
+
+#ifndef __LIBRETRO__
+void soundSaveGame(gzFile out)
+{
+    begin_save_state();
     utilWriteData(out, gba_state);
-#endif
 }
+#endif
 
 #ifndef __LIBRETRO__
 // Reads and discards count bytes from in
@@ -789,8 +1174,8 @@ static void soundReadGameOld(gzFile in, int version)
         utilReadData(in, old_gba_state2);
 
     // Restore PCM
-    pcm[0].dac = state.soundDSAValue;
-    pcm[1].dac = state.soundDSBValue;
+    snd->pcm[0].dac = state.soundDSAValue;
+    snd->pcm[1].dac = state.soundDSBValue;
 
     (void)utilReadInt(in); // ignore quality
 }
@@ -798,27 +1183,48 @@ static void soundReadGameOld(gzFile in, int version)
 
 #include <stdio.h>
 
-#ifdef __LIBRETRO__
-void soundReadGame(const uint8_t*& in, int version)
-#else
-void soundReadGame(gzFile in, int version)
-#endif
+static void begin_load_state()
 {
     // Prepare APU and default state
+    soundThreadSync();
     reset_apu();
-    gb_apu->save_state(&state.apu);
+    snd->gb_apu->save_state(&state.apu);
+}
+
+static void end_load_state()
+{
+    snd->gb_apu->load_state(state.apu);
+    write_SGCNT0_H(READ16LE(&ioMem[SGCNT0_H]) & 0x770F);
+
+    apply_muting();
+}
+
+void soundReadGame(const uint8_t*& in, int version)
+{
+    begin_load_state();
 
     if (version > SAVE_GAME_VERSION_9)
-#ifdef __LIBRETRO__
         utilReadDataMem(in, gba_state);
-#else
+
+    end_load_state();
+}
+
+void soundReadGameSkip(const uint8_t*& in, int version)
+{
+    if (version > SAVE_GAME_VERSION_9)
+        in += utilDataSize(gba_state);
+}
+
+#ifndef __LIBRETRO__
+void soundReadGame(gzFile in, int version)
+{
+    begin_load_state();
+
+    if (version > SAVE_GAME_VERSION_9)
         utilReadData(in, gba_state);
     else
         soundReadGameOld(in, version);
-#endif
-
-    gb_apu->load_state(state.apu);
-    write_SGCNT0_H(READ16LE(&ioMem[SGCNT0_H]) & 0x770F);
 
-    apply_muting();
+    end_load_state();
 }
+#endif
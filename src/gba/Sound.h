@@ -28,10 +28,48 @@ float soundGetVolume();
 void soundSetEnable(int mask);
 int soundGetEnable();
 
+// Timing-only mode: FIFOs are still drained and DMA still requested on
+// timer overflow, but no samples are synthesized or mixed. It is entered
+// automatically when every channel is muted or there is no sound driver.
+void soundSetTimingOnly(bool timingOnly);
+bool soundGetTimingOnly();
+
+// Sends the driver only one frame's worth of samples of every that many,
+// 1 for all of them. For fast forward: the game keeps being synthesized
+// as it runs, and what plays is it sped up with the rest cut out.
+void soundSetDecimation(int every);
+
+// Run-ahead: soundRunAheadBegin() sets the synthesizer side aside and
+// switches to timing-only; soundRunAheadEnd() puts it back, so the frames
+// emulated in between are never heard. The emulated state itself must be
+// restored separately, with CPUReadRawState(..., false).
+void soundRunAheadBegin();
+void soundRunAheadEnd();
+
+// Keeps synthesis running for systemOnWriteDataToSoundBuffer() even when
+// there is no sound driver or all channels are muted (sound recording).
+void soundSetCapture(bool capture);
+
+// Threaded synthesis: while enabled, the emulation thread only logs APU and
+// FIFO activity and another thread must keep calling soundThreadProcess()
+// to replay it into the synths and the sound driver. The frontend provides
+// systemSoundThreadNotify()/systemSoundThreadWait() to wake that thread and
+// to wait for it. soundThreadSync() waits until the log has been replayed.
+void soundSetThreaded(bool threaded);
+bool soundThreadProcess();
+void soundThreadSync();
+
+// Sound is per thread like the rest of the GBA. The thread calling
+// soundThreadProcess() has to be handed the emulation thread's first:
+// pass it soundGetContext() from there, and soundSetContext() it.
+// NULL goes back to the calling thread's own.
+struct Gba_Sound;
+Gba_Sound* soundGetContext();
+void soundSetContext(Gba_Sound* context);
+
 // Pauses/resumes system sound output
 void soundPause();
 void soundResume();
-extern bool soundPaused; // current paused state
 
 // Cleans up sound. Afterwards, soundInit() can be called again.
 void soundShutdown();
@@ -69,14 +107,15 @@ void interp_rate();
 
 // Notifies emulator that SOUND_CLOCK_TICKS clocks have passed
 void psoundTickfn();
-extern int SOUND_CLOCK_TICKS; // Number of 16.8 MHz clocks between calls to soundTick()
-extern int soundTicks; // Number of 16.8 MHz clocks until soundTick() will be called
+extern THREAD_STATE int SOUND_CLOCK_TICKS; // Number of 16.8 MHz clocks between calls to soundTick()
+extern THREAD_STATE int soundTicks; // Number of 16.8 MHz clocks until soundTick() will be called
 
 // Saves/loads emulator state
-#ifdef __LIBRETRO__
 void soundSaveGame(uint8_t*&);
 void soundReadGame(const uint8_t*& in, int version);
-#else
+void soundReadGameSkip(const uint8_t*& in, int version);
+unsigned soundSaveGameSize();
+#ifndef __LIBRETRO__
 void soundSaveGame(gzFile);
 void soundReadGame(gzFile, int version);
 #endif
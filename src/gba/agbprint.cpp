@@ -12,8 +12,8 @@
 #define debuggerReadHalfWord(addr) \
     READ16LE(((uint16_t*)&map[(addr) >> 24].address[(addr)&map[(addr) >> 24].mask]))
 
-static bool agbPrintEnabled = false;
-static bool agbPrintProtect = false;
+static THREAD_STATE bool agbPrintEnabled = false;
+static THREAD_STATE bool agbPrintProtect = false;
 
 bool agbPrintWrite(uint32_t address, uint16_t value)
 {
@@ -859,10 +859,12 @@ void BIOS_RegisterRamReset(uint32_t flags)
         if (flags & 0x01) {
             // clear work RAM
             memset(workRAM, 0, WORK_RAM_SIZE);
+            memset(dirtyWorkRAM, 1, sizeof(dirtyWorkRAM));
         }
         if (flags & 0x02) {
             // clear internal RAM
             memset(internalRAM, 0, 0x7e00); // don't clear 0x7e00-0x7fff
+            memset(dirtyInternalRAM, 1, sizeof(dirtyInternalRAM));
         }
         if (flags & 0x04) {
             // clear palette RAM
@@ -871,6 +873,7 @@ void BIOS_RegisterRamReset(uint32_t flags)
         if (flags & 0x08) {
             // clear VRAM
             memset(vram, 0, 0x18000);
+            memset(dirtyVRAM, 1, sizeof(dirtyVRAM));
         }
         if (flags & 0x10) {
             // clean OAM
@@ -1075,6 +1078,7 @@ void BIOS_SoftReset()
     uint8_t b = internalRAM[0x7ffa];
 
     memset(&internalRAM[0x7e00], 0, 0x200);
+    dirtyInternalRAM[0x7e00 >> DIRTY_PAGE_SHIFT] = 1;
 
     if (b) {
         armNextPC = 0x02000000;
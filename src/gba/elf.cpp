@@ -215,26 +215,26 @@ struct ELFFrameState {
     int returnAddress;
 };
 
-extern bool cpuIsMultiBoot;
+extern THREAD_STATE bool cpuIsMultiBoot;
 
-Symbol* elfSymbols = NULL;
-char* elfSymbolsStrTab = NULL;
-int elfSymbolsCount = 0;
+THREAD_STATE Symbol* elfSymbols = NULL;
+THREAD_STATE char* elfSymbolsStrTab = NULL;
+THREAD_STATE int elfSymbolsCount = 0;
 
-ELFSectionHeader** elfSectionHeaders = NULL;
-char* elfSectionHeadersStringTable = NULL;
-int elfSectionHeadersCount = 0;
-uint8_t* elfFileData = NULL;
+THREAD_STATE ELFSectionHeader** elfSectionHeaders = NULL;
+THREAD_STATE char* elfSectionHeadersStringTable = NULL;
+THREAD_STATE int elfSectionHeadersCount = 0;
+THREAD_STATE uint8_t* elfFileData = NULL;
 
-CompileUnit* elfCompileUnits = NULL;
-DebugInfo* elfDebugInfo = NULL;
-char* elfDebugStrings = NULL;
+THREAD_STATE CompileUnit* elfCompileUnits = NULL;
+THREAD_STATE DebugInfo* elfDebugInfo = NULL;
+THREAD_STATE char* elfDebugStrings = NULL;
 
-ELFcie* elfCies = NULL;
-ELFfde** elfFdes = NULL;
-int elfFdeCount = 0;
+THREAD_STATE ELFcie* elfCies = NULL;
+THREAD_STATE ELFfde** elfFdes = NULL;
+THREAD_STATE int elfFdeCount = 0;
 
-CompileUnit* elfCurrentUnit = NULL;
+THREAD_STATE CompileUnit* elfCurrentUnit = NULL;
 
 uint32_t elfRead4Bytes(uint8_t*);
 uint16_t elfRead2Bytes(uint8_t*);
@@ -265,7 +265,7 @@ CompileUnit* elfGetCompileUnit(uint32_t addr)
 
 const char* elfGetAddressSymbol(uint32_t addr)
 {
-    static char buffer[256];		//defining globalscope here just feels so wrong
+    static THREAD_STATE char buffer[256];		//defining globalscope here just feels so wrong
 
     CompileUnit* unit = elfGetCompileUnit(addr);
     // found unit, need to find function
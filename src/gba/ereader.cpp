@@ -11,11 +11,11 @@
 char US_Ereader[19] = "CARDE READERPSAE01";
 char JAP_Ereader[19] = "CARDE READERPEAJ01";
 char JAP_Ereader_plus[19] = "CARDEREADER+PSAJ01";
-char rom_info[19];
+THREAD_STATE char rom_info[19];
 
 char Signature[0x29] = "E-Reader Dotcode -Created- by CaitSith2";
 
-unsigned char ShortDotCodeHeader[0x30] = {
+THREAD_STATE unsigned char ShortDotCodeHeader[0x30] = {
     0x00, 0x30, 0x01, 0x01,
     0x00, 0x01, 0x05, 0x10,
     0x00, 0x00, 0x10, 0x12, //Constant data
@@ -39,7 +39,7 @@ unsigned char ShortDotCodeHeader[0x30] = {
     0x57 //Global Checksum 2
 };
 
-unsigned char LongDotCodeHeader[0x30] = {
+THREAD_STATE unsigned char LongDotCodeHeader[0x30] = {
     0x00, 0x30, 0x01, 0x02,
     0x00, 0x01, 0x08, 0x10,
     0x00, 0x00, 0x10, 0x12, //Constant Data
@@ -62,30 +62,30 @@ unsigned char LongDotCodeHeader[0x30] = {
     0x57 //Global Checksum 2
 };
 
-unsigned char shortheader[0x18] = {
+THREAD_STATE unsigned char shortheader[0x18] = {
     0x00, 0x02, 0x00, 0x01, 0x40, 0x10, 0x00, 0x1C,
     0x10, 0x6F, 0x40, 0xDA, 0x39, 0x25, 0x8E, 0xE0,
     0x7B, 0xB5, 0x98, 0xB6, 0x5B, 0xCF, 0x7F, 0x72
 };
-unsigned char longheader[0x18] = {
+THREAD_STATE unsigned char longheader[0x18] = {
     0x00, 0x03, 0x00, 0x19, 0x40, 0x10, 0x00, 0x2C,
     0x0E, 0x88, 0xED, 0x82, 0x50, 0x67, 0xFB, 0xD1,
     0x43, 0xEE, 0x03, 0xC6, 0xC6, 0x2B, 0x2C, 0x93
 };
 
-unsigned char dotcodeheader[0x48];
-unsigned char dotcodedata[0xB38];
-unsigned char dotcodetemp[0xB00];
-int dotcodepointer;
-int dotcodeinterleave;
-int decodestate;
+THREAD_STATE unsigned char dotcodeheader[0x48];
+THREAD_STATE unsigned char dotcodedata[0xB38];
+THREAD_STATE unsigned char dotcodetemp[0xB00];
+THREAD_STATE int dotcodepointer;
+THREAD_STATE int dotcodeinterleave;
+THREAD_STATE int decodestate;
 
-uint32_t GFpow;
+THREAD_STATE uint32_t GFpow;
 
-unsigned char* DotCodeData;
-char filebuffer[2048];
+THREAD_STATE unsigned char* DotCodeData;
+THREAD_STATE char filebuffer[2048];
 
-int dotcodesize;
+THREAD_STATE int dotcodesize;
 
 #if (defined __WIN32__ || defined _WIN32)
 #define strcasecmp _stricmp
@@ -200,9 +200,11 @@ void EReaderWriteMemory(uint32_t address, uint32_t value)
 {
     switch (address >> 24) {
     case 2:
+        dirtyWorkRAM[(address & 0x3FFFF) >> DIRTY_PAGE_SHIFT] = 1;
         WRITE32LE(((uint32_t*)&workRAM[address & 0x3FFFF]), value);
         break;
     case 3:
+        dirtyInternalRAM[(address & 0x7FFF) >> DIRTY_PAGE_SHIFT] = 1;
         WRITE32LE(((uint32_t*)&internalRAM[address & 0x7FFF]), value);
         break;
     default:
@@ -1,5 +1,5 @@
-extern unsigned char* DotCodeData;
-extern char filebuffer[];
+extern THREAD_STATE unsigned char* DotCodeData;
+extern THREAD_STATE char filebuffer[];
 
 int OpenDotCodeFile(void);
 int CheckEReaderRegion(void);
@@ -27,7 +27,7 @@
 #define BreakCheck(array, addr, flag) \
     ((uint8_t*)(array))[(addr) >> 1] & ((addr & 1) ? (flag << 4) : (flag & 0xf))
 
-extern bool debugger;
+extern THREAD_STATE bool debugger;
 
 extern bool dexp_eval(char*, uint32_t*);
 extern void dexp_setVar(char*, uint32_t);
@@ -0,0 +1,294 @@
+// VisualBoyAdvance - Nintendo Gameboy/GameboyAdvance (TM) emulator.
+// Copyright (C) 2015 VBA-M development team
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or(at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../System.h"
+#include "../Util.h"
+#include "../common/ConfigManager.h"
+#include "../gba/GBA.h"
+#include "../gba/Globals.h"
+#include "../gba/Movie.h"
+#include "../gba/Sound.h"
+
+#include "libvbam.h"
+
+// RGB565, what vbam_video() promises
+int systemRedShift = 11;
+int systemGreenShift = 6;
+int systemBlueShift = 0;
+int systemColorDepth = 16;
+int systemVerbose = 0;
+THREAD_STATE int systemFrameSkip = 0;
+THREAD_STATE int systemSaveUpdateCounter = SYSTEM_SAVE_NOT_UPDATED;
+int systemSpeed = 0;
+uint16_t systemColorMap16[0x10000];
+uint32_t systemColorMap32[0x10000];
+uint16_t systemGbPalette[24];
+int emulating = 0;
+
+static THREAD_STATE int frames = 0;
+static THREAD_STATE uint32_t pad = 0;
+static THREAD_STATE bool video = true;
+
+// What systemOnWriteDataToSoundBuffer got during the current step
+static THREAD_STATE int16_t *audio = NULL;
+static THREAD_STATE int audioLength = 0; // in samples, both channels
+static THREAD_STATE int audioSize = 0;
+
+//// The frontend side of the core
+
+void log(const char *msg, ...)
+{
+	va_list valist;
+
+	va_start(valist, msg);
+	vfprintf(stderr, msg, valist);
+	va_end(valist);
+}
+
+void systemMessage(int, const char *msg, ...)
+{
+	va_list valist;
+
+	va_start(valist, msg);
+	vfprintf(stderr, msg, valist);
+	fprintf(stderr, "\n");
+	va_end(valist);
+}
+
+// Every frame ends emuMain(), vbam_step() counts them
+bool systemPauseOnFrame()
+{
+	return true;
+}
+
+void systemFrame()
+{
+	frames++;
+}
+
+bool systemReadJoypads()
+{
+	return true;
+}
+
+uint32_t systemReadJoypad(int)
+{
+	return pad;
+}
+
+uint32_t systemPollJoypad(int)
+{
+	return pad;
+}
+
+uint32_t systemGetClock()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+SoundDriver *systemSoundInit()
+{
+	return NULL;
+}
+
+void systemOnWriteDataToSoundBuffer(const uint16_t *finalWave, int length)
+{
+	int samples = length / 2;
+
+	if (audioLength + samples > audioSize) {
+		int size = audioSize ? audioSize : 4096;
+		while (audioLength + samples > size)
+			size *= 2;
+		int16_t *grown = (int16_t *)realloc(audio, size * sizeof *audio);
+		if (!grown)
+			return;
+		audio = grown;
+		audioSize = size;
+	}
+	memcpy(audio + audioLength, finalWave, samples * sizeof *audio);
+	audioLength += samples;
+}
+
+// Synthesis is never threaded here
+void systemSoundThreadNotify() {}
+void systemSoundThreadWait() {}
+
+void systemDrawScreen() {}
+void systemGbPrint(uint8_t *, int, int, int, int, int) {}
+void systemScreenCapture(int) {}
+void systemSetTitle(const char *) {}
+void systemOnSoundShutdown() {}
+void systemScreenMessage(const char *) {}
+void systemUpdateMotionSensor() {}
+int systemGetSensorX() { return 0; }
+int systemGetSensorY() { return 0; }
+int systemGetSensorZ() { return 0; }
+uint8_t systemGetSensorDarkness() { return 0; }
+void systemCartridgeRumble(bool) {}
+void systemPossibleCartridgeRumble(bool) {}
+void updateRumbleFrame() {}
+bool systemCanChangeSoundQuality() { return false; }
+void systemShowSpeed(int) {}
+void system10Frames(int) {}
+void systemGbBorderOn() {}
+void Sm60FPS_Init() {}
+bool Sm60FPS_CanSkipFrame() { return false; }
+void Sm60FPS_Sleep() {}
+
+//// The library
+
+int vbam_load_rom(const void *data, int size, const char *bios)
+{
+	// The color maps are shared, and the same for every thread
+	static bool colorMaps = (utilUpdateSystemColorMaps(), true);
+	(void)colorMaps;
+
+	// CPULoadRomData copies without checking
+	if (!data || size <= 0 || size > (cpuIsMultiBoot ? 0x40000 : 0x2000000))
+		return 0;
+
+	soundSetCapture(true);
+
+	int romSize = CPULoadRomData((const char *)data, size);
+	if (!romSize)
+		return 0;
+
+	if (cpuSaveType == 0)
+		utilGBAFindSave(romSize);
+	else
+		saveType = cpuSaveType;
+	doMirroring(mirroringEnable);
+
+	CPUInit(bios, bios != NULL);
+	CPUReset();
+	return 1;
+}
+
+void vbam_reset(void)
+{
+	if (rom)
+		CPUReset();
+}
+
+void vbam_unload(void)
+{
+	movieStop();
+	if (rom)
+		CPUCleanUp();
+
+	free(audio);
+	audio = NULL;
+	audioLength = audioSize = 0;
+}
+
+int vbam_step(int count, uint32_t input)
+{
+	if (!rom)
+		return 0;
+
+	// The bits above the pad are the SDL frontend's speedup and capture
+	pad = input & 0x3ff;
+	audioLength = 0;
+
+	for (int i = 0; i < count; i++) {
+		cpuRenderEnabled = video && i == count - 1;
+		int frame = frames;
+		while (frames == frame)
+			GBASystem.emuMain(GBASystem.emuCount);
+	}
+	cpuRenderEnabled = true;
+	return count > 0 ? count : 0;
+}
+
+void vbam_set_video(int enabled)
+{
+	video = enabled != 0;
+}
+
+void vbam_set_audio(int enabled)
+{
+	soundSetTimingOnly(!enabled);
+}
+
+const uint16_t *vbam_video(void)
+{
+	return (const uint16_t *)pix;
+}
+
+const int16_t *vbam_audio(int *count)
+{
+	if (count)
+		*count = audioLength / 2;
+	return audio;
+}
+
+int vbam_sample_rate(void)
+{
+	return (int)soundGetSampleRate();
+}
+
+unsigned vbam_state_size(void)
+{
+	return rom ? CPURawStateSize() : 0;
+}
+
+unsigned vbam_save_state(void *data, unsigned size)
+{
+	if (!rom)
+		return 0;
+	return CPUWriteRawState((uint8_t *)data, size);
+}
+
+int vbam_load_state(const void *data, unsigned size)
+{
+	if (!rom)
+		return 0;
+	return CPUReadRawState((const uint8_t *)data, size);
+}
+
+int vbam_movie_record(const char *file, int from_state)
+{
+	if (!rom)
+		return 0;
+	return movieRecord(file, from_state != 0);
+}
+
+int vbam_movie_play(const char *file)
+{
+	if (!rom)
+		return 0;
+	return moviePlay(file);
+}
+
+int vbam_movie_playing(void)
+{
+	return moviePlaying();
+}
+
+int vbam_movie_stop(void)
+{
+	movieStop();
+	return movieDesyncFrame();
+}
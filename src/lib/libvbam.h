@@ -0,0 +1,113 @@
+// VisualBoyAdvance - Nintendo Gameboy/GameboyAdvance (TM) emulator.
+// Copyright (C) 2015 VBA-M development team
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or(at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#ifndef __VBA_LIBVBAM_H__
+#define __VBA_LIBVBAM_H__
+
+#include <stdint.h>
+
+/*
+ * The GBA core without a frontend, for test harnesses and bots: no window,
+ * no audio device, no clock. Frames run as fast as they can be emulated.
+ *
+ * Every thread has a GBA of its own, so the calls below act on the calling
+ * thread's. Run several games at once from several threads.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define VBAM_WIDTH 240
+#define VBAM_HEIGHT 160
+
+/* Buttons for vbam_step(), as KEYINPUT has them but set when held */
+enum {
+	VBAM_BUTTON_A = 0x001,
+	VBAM_BUTTON_B = 0x002,
+	VBAM_BUTTON_SELECT = 0x004,
+	VBAM_BUTTON_START = 0x008,
+	VBAM_BUTTON_RIGHT = 0x010,
+	VBAM_BUTTON_LEFT = 0x020,
+	VBAM_BUTTON_UP = 0x040,
+	VBAM_BUTTON_DOWN = 0x080,
+	VBAM_BUTTON_R = 0x100,
+	VBAM_BUTTON_L = 0x200
+};
+
+/*
+ * Loads a ROM image from memory and resets into it, replacing whatever
+ * was loaded. The image is copied, data can be freed afterwards. bios is
+ * the path of a BIOS file, or NULL to have its calls emulated. Returns 0
+ * on failure.
+ */
+int vbam_load_rom(const void *data, int size, const char *bios);
+void vbam_reset(void);
+void vbam_unload(void);
+
+/*
+ * Runs frames frames with input held, returns the number run (0 when no
+ * ROM is loaded). Only the last of them is rendered.
+ */
+int vbam_step(int frames, uint32_t input);
+
+/* Turns rendering off altogether, or back on. On by default. */
+void vbam_set_video(int enabled);
+/* Turns sound synthesis off altogether, or back on. On by default. */
+void vbam_set_audio(int enabled);
+
+/*
+ * The frame the last vbam_step() rendered: VBAM_WIDTH x VBAM_HEIGHT
+ * RGB565 pixels, with no padding between lines. The core draws into it
+ * directly, so it is only valid until the next step or load.
+ */
+const uint16_t *vbam_video(void);
+
+/*
+ * The sound the last vbam_step() made, as interleaved stereo samples at
+ * vbam_sample_rate(). Sets *count to the number of stereo pairs. Valid
+ * until the next step.
+ */
+const int16_t *vbam_audio(int *count);
+int vbam_sample_rate(void);
+
+/*
+ * Savestates in memory. They are uncompressed and always
+ * vbam_state_size() bytes for a given ROM. vbam_save_state() returns the
+ * bytes written, 0 if size is too small or no ROM is loaded.
+ */
+unsigned vbam_state_size(void);
+unsigned vbam_save_state(void *data, unsigned size);
+int vbam_load_state(const void *data, unsigned size);
+
+/*
+ * Input movies, see src/gba/Movie.h. A recording keeps the input given to
+ * vbam_step(), from the current state or from power-on. Playback loads the
+ * movie's start and then overrides the input until it ends.
+ * vbam_movie_stop() returns the first frame playback found out of sync,
+ * -1 if none.
+ */
+int vbam_movie_record(const char *file, int from_state);
+int vbam_movie_play(const char *file);
+int vbam_movie_playing(void);
+int vbam_movie_stop(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __VBA_LIBVBAM_H__
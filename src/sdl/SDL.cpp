@@ -36,6 +36,7 @@
 #include "../gba/GBA.h"
 #include "../gba/agbprint.h"
 #include "../gba/Flash.h"
+#include "../gba/Movie.h"
 #include "../gba/RTC.h"
 #include "../gba/Sound.h"
 
@@ -43,6 +44,10 @@
 #include "text.h"
 #include "inputSDL.h"
 #include "../common/SoundSDL.h"
+#include "../common/SoundRecorder.h"
+#include "../common/BackgroundWriter.h"
+#include "../common/RewindBuffer.h"
+#include "../common/FramePacer.h"
 
 # include <unistd.h>
 # define GETCWD getcwd
@@ -83,8 +88,8 @@ int systemGreenShift = 5;
 /* 0 is default */
 int systemColorDepth = 16;
 int systemVerbose = 0;
-int systemFrameSkip = 0;
-int systemSaveUpdateCounter = SYSTEM_SAVE_NOT_UPDATED;
+THREAD_STATE int systemFrameSkip = 0;
+THREAD_STATE int systemSaveUpdateCounter = SYSTEM_SAVE_NOT_UPDATED;
 
 int srcPitch = 0;
 int destWidth = 0;
@@ -137,7 +142,48 @@ int sdlMirroringEnable = 1;
 
 static int ignore_first_resize_event = 0;
 
+static SDL_Thread *sdlSoundThread = NULL;
+static SDL_sem *sdlSoundThreadWork = NULL;
+static SDL_sem *sdlSoundThreadDone = NULL;
+static volatile int sdlSoundThreadQuit = 0;
+
+// --present-thread: the core draws into one of three pictures and hands
+// each finished one over through sdlFrameReady, the present thread scales
+// and flips the newest. Each thread owns the picture it is on; the third
+// is the one waiting in sdlFrameReady.
+#define SDL_FRAME_FRESH 0x100
+static SDL_Thread *sdlPresentThread = NULL;
+static SDL_sem *sdlPresentWork = NULL;
+static SDL_mutex *sdlPresentLock = NULL; // held while presenting
+static volatile int sdlPresentQuit = 0;
+static uint8_t *sdlFrames[3];
+static uint8_t *sdlCorePix = NULL; // pix as the core allocated it
+static int sdlFrameWrite = 0; // the core's
+static int sdlFrameLast = 0; // handed over last, for screenshots
+static int sdlFramePresent = 1; // the present thread's
+static int sdlFrameReady = 2; // index, | SDL_FRAME_FRESH until taken
+
+static SoundRecorder sdlSoundRecorder;
+// savestates and screenshots are written from here, off the emulation thread
+static BackgroundWriter sdlWriter;
+
+static RewindBuffer sdlRewind;
+static int sdlRewinding = 0;
+
+static int sdlFrameCount = 0;
+// Paces frames whenever the sound driver isn't blocking on its buffer
+static FramePacer sdlPacer;
+static bool sdlSoundOpened = false;
+static bool sdlFastForwarding = false; // speedup held, see sdlFastForward()
+static uint8_t *sdlRunAheadState = NULL;
+static unsigned sdlRunAheadSize = 0;
+static int sdlRunAheadHidden = 0;
+
 /* forward */
+static void sdlPrintFrameTimes();
+static void sdlPresentThreadStart();
+static void sdlPresentThreadStop();
+void sdlStopMovie();
 void systemConsoleMessage(const char*);
 
 char* home;
@@ -349,6 +395,59 @@ static void sdlApplyPerImagePreferences()
   fclose(f);
 }
 
+// Save types utilGBAScanSave found, kept in vba-save.ini next to
+// vba-over.ini so a game's ROM is only scanned the first time. One line
+// per image: game code, CRC of the header, size, save type, Flash size
+// and RTC.
+static void sdlFindSaveType(int size)
+{
+  char path[2048];
+
+  if(homeDir)
+    snprintf(path, sizeof path, "%s/%s/vba-save.ini", homeDir, DOT_DIR);
+  else
+    snprintf(path, sizeof path, "vba-save.ini");
+
+  char code[5];
+  for(int i = 0; i < 4; i++) {
+    char c = rom[0xac + i];
+    code[i] = ((c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z')) ? c : '_';
+  }
+  code[4] = 0;
+  unsigned long crc = crc32(0L, rom, 0xc0);
+
+  int type, flashSize, rtc;
+  FILE *f = fopen(path, "r");
+  if(f) {
+    char line[256];
+    while(fgets(line, sizeof line, f)) {
+      char lineCode[5];
+      unsigned long lineCrc;
+      int lineSize;
+
+      if(sscanf(line, "%4s %lx %d %d %d %d", lineCode, &lineCrc, &lineSize,
+                &type, &flashSize, &rtc) == 6
+         && !strcmp(lineCode, code) && lineCrc == crc && lineSize == size) {
+        fclose(f);
+        utilGBASetSave(type, flashSize, rtc != 0);
+        return;
+      }
+    }
+    fclose(f);
+  }
+
+  bool rtcFound;
+  type = utilGBAScanSave(rom, size, flashSize, rtcFound);
+  utilGBASetSave(type, flashSize, rtcFound);
+
+  f = fopen(path, "a");
+  if(f) {
+    fprintf(f, "%s %08lx %d %d %d %d\n", code, crc, size, type, flashSize,
+            rtcFound ? 1 : 0);
+    fclose(f);
+  }
+}
+
 static int sdlCalculateShift(uint32_t mask)
 {
   int m = 0;
@@ -380,14 +479,45 @@ static char * sdlStateName(int num)
   return stateName;
 }
 
+// Copy of the picture for sdlWriter. The PNG and BMP writers step over
+// a border line and column the filters use, so leave room for those.
+static uint8_t *sdlCapturePicture()
+{
+  uint8_t *picture = (uint8_t *)calloc(1, 4 * 242 * 162);
+
+  // pix itself is only half drawn again with the present thread
+  if(picture)
+    memcpy(picture, sdlPresentThread ? sdlFrames[sdlFrameLast] : pix, 2 * 240 * 160);
+  return picture;
+}
+
+static void sdlCheckWriter()
+{
+  const char *failed = sdlWriter.failed();
+
+  if(failed) {
+    char buffer[2100];
+    snprintf(buffer, sizeof buffer, "Failed to write %s", sdlGetFilename((char *)failed));
+    systemScreenMessage(buffer);
+  }
+}
+
 void sdlWriteState(int num)
 {
   char * stateName;
 
   stateName = sdlStateName(num);
 
-  if(emulator.emuWriteState)
-    emulator.emuWriteState(stateName);
+  // Only the copy happens here, sdlWriter compresses and writes it
+  unsigned size = CPURawStateSize();
+  uint8_t *state = (uint8_t *)malloc(size);
+  if(state && (size = CPUWriteState(state, size)) != 0)
+    sdlWriter.writeGz(stateName, state, size);
+  else {
+    free(state);
+    if(emulator.emuWriteState)
+      emulator.emuWriteState(stateName);
+  }
 
   // now we reuse the stateName buffer - 2048 bytes fit in a lot
   if (num == SLOT_POS_LOAD_BACKUP)
@@ -409,6 +539,9 @@ void sdlReadState(int num)
   char * stateName;
 
   stateName = sdlStateName(num);
+  // it may still be on its way to the disk
+  sdlWriter.wait();
+  sdlStopMovie();
   if(emulator.emuReadState)
     emulator.emuReadState(stateName);
 
@@ -473,6 +606,82 @@ void sdlWriteBackupStateExchange(int from, int to, int backup)
   free(stateNameBack);
 }
 
+// Where an archived ROM gets unpacked to be paged in, the battery
+// directory since that has to be writable anyway
+static const char *sdlRomPagingDir()
+{
+  static char dir[2048];
+
+  if(batteryDir)
+    snprintf(dir, sizeof dir, "%s", batteryDir);
+  else if (homeDir)
+    snprintf(dir, sizeof dir, "%s/%s", homeDir, DOT_DIR);
+  else {
+    snprintf(dir, sizeof dir, "%s", filename);
+    char *p = strrchr(dir, '/');
+    if(p)
+      *p = 0;
+    else
+      strcpy(dir, ".");
+  }
+
+  return dir;
+}
+
+// Summary of which ROM banks the game kept in memory, for --rom-paging
+static void sdlPrintRomBanks()
+{
+  uint8_t banks[ROM_SIZE / ROM_BANK_SIZE];
+  int total = CPURomBankResidency(banks, ROM_SIZE / ROM_BANK_SIZE);
+  int resident = 0, full = 0;
+
+  for(int i = 0; i < total; i++) {
+    if(banks[i])
+      resident++;
+    if(banks[i] == 100)
+      full++;
+  }
+
+  if(total)
+    fprintf(stdout, "ROM banks in memory: %d of %d (%d fully), %d KB each\n",
+            resident, total, full, ROM_BANK_SIZE / 1024);
+}
+
+// --benchmark: runs frames frames as fast as they go, then prints the
+// rate and where the time went as one line of JSON, to compare builds
+static void sdlBenchmark(int frames)
+{
+  static const char *names[TIMING_COUNT] = {
+    "render", "convert", "sound", "dma", "present", "sound_wait"
+  };
+
+  memset(cpuTiming, 0, sizeof cpuTiming);
+  cpuTimingEnabled = true;
+
+  // a movie being played is the workload, up to its end
+  bool movie = moviePlaying();
+  int first = sdlFrameCount;
+  uint64_t start = CPUTimingNow();
+  while(sdlFrameCount - first < frames && (!movie || moviePlaying()))
+    emulator.emuMain(emulator.emuCount);
+  uint64_t total = CPUTimingNow() - start;
+
+  cpuTimingEnabled = false;
+  frames = sdlFrameCount - first;
+
+  // the CPU is everything the other parts don't account for
+  uint64_t cpu = total;
+  for(int i = 0; i < TIMING_COUNT; i++)
+    cpu -= cpu < cpuTiming[i] ? cpu : cpuTiming[i];
+
+  fprintf(stdout, "{\"frames\":%d,\"frameskip\":%d,\"seconds\":%.3f,\"fps\":%.2f,\"cpu_ms\":%.1f",
+          frames, systemFrameSkip, total / 1e9, total ? frames * 1e9 / total : 0.0,
+          cpu / 1e6);
+  for(int i = 0; i < TIMING_COUNT; i++)
+    fprintf(stdout, ",\"%s_ms\":%.1f", names[i], cpuTiming[i] / 1e6);
+  fprintf(stdout, "}\n");
+}
+
 void sdlWriteBattery()
 {
   char buffer[1048];
@@ -484,7 +693,10 @@ void sdlWriteBattery()
   else
     sprintf(buffer, "%s.sav", filename);
 
-  emulator.emuWriteBattery(buffer);
+  if(mmapBattery)
+    CPUSyncBatteryFile(buffer);
+  else
+    emulator.emuWriteBattery(buffer);
 
   systemScreenMessage("Wrote battery");
 }
@@ -508,6 +720,140 @@ void sdlReadBattery()
     systemScreenMessage("Loaded battery");
 }
 
+void sdlStartSoundRecording()
+{
+  char buffer[2048];
+
+  // first free NAME##.wav, so earlier recordings are kept
+  for(int i = 0; i < 100; i++) {
+    sprintf(buffer, "%s/%s%02d.wav", soundRecordDir, sdlGetFilename(filename), i);
+    FILE *f = fopen(buffer, "rb");
+    if(!f)
+      break;
+    fclose(f);
+  }
+
+  if(sdlSoundRecorder.start(buffer, soundGetSampleRate())) {
+    soundRecording = 1;
+    soundSetCapture(true);
+    systemScreenMessage("Sound recording");
+  }
+}
+
+void sdlStopSoundRecording()
+{
+  if(!soundRecording)
+    return;
+
+  soundSetCapture(false);
+  soundRecording = 0;
+  sdlSoundRecorder.stop();
+}
+
+// Records to the first free NAME##.vmv in movieRecordDir, or with the
+// savestates
+void sdlStartMovieRecording(bool fromState)
+{
+  char buffer[2048];
+  const char *dir = movieRecordDir && *movieRecordDir ? movieRecordDir : saveDir;
+
+  for(int i = 0; i < 100; i++) {
+    if(dir)
+      sprintf(buffer, "%s/%s%02d.vmv", dir, sdlGetFilename(filename), i);
+    else
+      sprintf(buffer, "%s%02d.vmv", filename, i);
+    FILE *f = fopen(buffer, "rb");
+    if(!f)
+      break;
+    fclose(f);
+  }
+
+  if(movieRecord(buffer, fromState)) {
+    fprintf(stdout, "Recording movie %s\n", buffer);
+    systemScreenMessage("Movie recording");
+  }
+}
+
+// Anything that moves the game somewhere the pad didn't take it ends the
+// movie: loading a state, rewinding, resetting
+void sdlStopMovie()
+{
+  if(!movieRecording() && !moviePlaying())
+    return;
+
+  bool recording = movieRecording();
+  movieStop();
+  fprintf(stdout, "Movie %s after %d frames\n",
+          recording ? "recorded" : "stopped", movieFrame());
+  systemScreenMessage(recording ? "Movie recording stopped" : "Movie stopped");
+}
+
+void sdlRewindStep()
+{
+  sdlStopMovie();
+
+  if(!sdlRewind.stepBack(emulator)) {
+    systemScreenMessage("No rewind history");
+    sdlRewinding = 0;
+    return;
+  }
+
+  rewindCounter = 0;
+  systemDrawScreen();
+  // nothing is emulated, so nothing throttles; step at about 60 Hz
+  SDL_Delay(16);
+}
+
+// Emulates up to the start of the next vblank
+static void sdlRunFrame()
+{
+  int frame = sdlFrameCount;
+
+  while(emulating && sdlFrameCount == frame)
+    emulator.emuMain(emulator.emuCount);
+}
+
+// One real frame, heard but not shown, then runAhead frames with the
+// same input of which only the last is shown and none is heard. The
+// state after the real frame is put back, so the game only ever sees
+// the real ones, but what is on screen is runAhead frames ahead.
+void sdlRunAheadFrame()
+{
+  if(!sdlRunAheadState) {
+    sdlRunAheadSize = CPURawStateSize();
+    sdlRunAheadState = (uint8_t *)malloc(sdlRunAheadSize);
+    if(!sdlRunAheadState) {
+      systemMessage(0, "Failed to allocate run-ahead state");
+      runAhead = 0;
+      return;
+    }
+  }
+
+  cpuRenderEnabled = false;
+  sdlRunFrame();
+
+  // loading the state clears it, but battery writes of the real frame
+  // still have to reach the disk
+  int saveUpdateCounter = systemSaveUpdateCounter;
+
+  // both only copy the memory pages stored to in between
+  CPUWriteRawStateDirty(sdlRunAheadState, sdlRunAheadSize);
+  soundRunAheadBegin();
+  sdlRunAheadHidden = 1;
+
+  for(int i = 0; i < runAhead; i++) {
+    cpuRenderEnabled = (i == runAhead - 1);
+    sdlRunFrame();
+  }
+
+  sdlRunAheadHidden = 0;
+  CPUReadRawStateDirty(sdlRunAheadState, sdlRunAheadSize, false);
+  soundRunAheadEnd();
+  cpuRenderEnabled = true;
+
+  systemSaveUpdateCounter = saveUpdateCounter;
+}
+
 void sdlReadDesktopVideoMode() {
   const SDL_VideoInfo* vInfo = SDL_GetVideoInfo();
   desktopWidth = vInfo->current_w;
@@ -527,10 +873,11 @@ void sdlInitVideo() {
 	screenWidth = destWidth;
     screenHeight = destHeight;
 
-	real_video = SDL_SetVideoMode(0, 0, 16, SDL_HWSURFACE);
-	
-	SDL_FillRect(real_video, NULL, 0);
-	SDL_Flip(real_video);
+	if (benchmarkFrames)
+		// nothing is shown, systemDrawScreen still scales into this
+		real_video = SDL_CreateRGBSurface(SDL_SWSURFACE, 320, 240, 16, 0xF800, 0x07E0, 0x001F, 0);
+	else
+		real_video = SDL_SetVideoMode(0, 0, 16, SDL_HWSURFACE);
 	
 	if (real_video == NULL) 
 	{
@@ -538,6 +885,10 @@ void sdlInitVideo() {
 		SDL_Quit();
 		exit(-1);
 	}
+
+	SDL_FillRect(real_video, NULL, 0);
+	if (!benchmarkFrames)
+		SDL_Flip(real_video);
 	
 	rmask = real_video->format->Rmask;
 	gmask = real_video->format->Gmask;
@@ -676,14 +1027,23 @@ void sdlPollEvents()
     case SDL_JOYBUTTONUP:
     case SDL_JOYAXISMOTION:
     case SDL_KEYDOWN:
+      if(event.key.keysym.sym == SDLK_b &&
+         !(event.key.keysym.mod & MOD_NOCTRL) &&
+         (event.key.keysym.mod & KMOD_CTRL)) {
+        sdlRewinding = 1;
+      }
       inputProcessSDLEvent(event);
       break;
     case SDL_KEYUP:
       switch(event.key.keysym.sym) {
+      case SDLK_b:
+        sdlRewinding = 0;
+        break;
       case SDLK_r:
         if(!(event.key.keysym.mod & MOD_NOCTRL) &&
            (event.key.keysym.mod & KMOD_CTRL)) {
           if(emulating) {
+            sdlStopMovie();
             emulator.emuReset();
 
             systemScreenMessage("Reset");
@@ -733,7 +1093,11 @@ void sdlPollEvents()
         if(!(event.key.keysym.mod & MOD_NOCTRL) &&
            (event.key.keysym.mod & KMOD_CTRL)) {
           fullScreen = !fullScreen;
+          if(sdlPresentLock)
+            SDL_mutexP(sdlPresentLock);
           sdlInitVideo();
+          if(sdlPresentLock)
+            SDL_mutexV(sdlPresentLock);
         }
         break;
       case SDLK_F11:
@@ -834,6 +1198,15 @@ void sdlPollEvents()
           pauseNextFrame = true;
         }
         break;
+      case SDLK_m:
+        if(!(event.key.keysym.mod & MOD_NOCTRL) &&
+           (event.key.keysym.mod & KMOD_CTRL)) {
+          if(movieRecording() || moviePlaying())
+            sdlStopMovie();
+          else
+            sdlStartMovieRecording(true);
+        }
+        break;
       default:
         break;
       }
@@ -843,6 +1216,58 @@ void sdlPollEvents()
   }
 }
 
+static int sdlSoundThreadMain(void *context)
+{
+  // the sound being synthesized is the emulation thread's
+  soundSetContext((Gba_Sound *)context);
+
+  while(!sdlSoundThreadQuit) {
+    SDL_SemWait(sdlSoundThreadWork);
+
+    while(soundThreadProcess()) {
+      if(SDL_SemValue(sdlSoundThreadDone) == 0)
+        SDL_SemPost(sdlSoundThreadDone);
+    }
+  }
+
+  return 0;
+}
+
+static void sdlSoundThreadStart()
+{
+  sdlSoundThreadWork = SDL_CreateSemaphore(0);
+  sdlSoundThreadDone = SDL_CreateSemaphore(0);
+  sdlSoundThreadQuit = 0;
+
+  sdlSoundThread = SDL_CreateThread(sdlSoundThreadMain, soundGetContext());
+  if(!sdlSoundThread) {
+    fprintf(stderr, "Failed to start sound thread: %s\n", SDL_GetError());
+    SDL_DestroySemaphore(sdlSoundThreadWork);
+    SDL_DestroySemaphore(sdlSoundThreadDone);
+    sdlSoundThreadWork = sdlSoundThreadDone = NULL;
+    return;
+  }
+
+  soundSetThreaded(true);
+}
+
+static void sdlSoundThreadStop()
+{
+  if(!sdlSoundThread)
+    return;
+
+  soundSetThreaded(false);
+
+  sdlSoundThreadQuit = 1;
+  SDL_SemPost(sdlSoundThreadWork);
+  SDL_WaitThread(sdlSoundThread, NULL);
+  sdlSoundThread = NULL;
+
+  SDL_DestroySemaphore(sdlSoundThreadWork);
+  SDL_DestroySemaphore(sdlSoundThreadDone);
+  sdlSoundThreadWork = sdlSoundThreadDone = NULL;
+}
+
 void usage(char *cmd)
 {
   printf("%s [option ...] file\n", cmd);
@@ -908,6 +1333,23 @@ Long options only:\n\
       --rtc                    Enable RTC support\n\
       --show-speed-normal      Show emulation speed\n\
       --show-speed-detailed    Show detailed speed data\n\
+      --rewind-timer=FRAMES    Keep a rewind snapshot every FRAMES frames\n\
+                               (0 - off), hold Ctrl+B to rewind\n\
+      --run-ahead=FRAMES       Show FRAMES frames ahead to hide input lag\n\
+                               (0...6)\n\
+      --mmap-battery           Keep the .sav file mapped, write changed pages only\n\
+      --rom-paging             Only keep the ROM banks in use in memory\n\
+      --benchmark=FRAMES       Run FRAMES frames headless and unthrottled, then\n\
+                               print where the time went as JSON and exit\n\
+      --rom-cache-dir=DIR      Keep unpacked copies of zipped ROMs in DIR\n\
+      --rom-cache-size=MB      Size limit of the ROM cache (0 - none)\n\
+      --sound-thread           Run sound synthesis on its own thread\n\
+      --present-thread         Scale and show frames on their own thread\n\
+      --poll-keyinput          Read the pad whenever the game reads KEYINPUT\n\
+      --fast-forward-audio     Play sped up sound while fast forwarding\n\
+      --movie-record-dir=DIR   Record the pad from power-on to a movie in DIR,\n\
+                               Ctrl+M records from the current state\n\
+      --movie-play=FILE        Play the movie FILE back\n\
       --cheat 'CHEAT'          Add a cheat\n\
 ");
 }
@@ -988,7 +1430,7 @@ int main(int argc, char **argv)
       patchNum++;
     }
 
-    soundInit();
+    sdlSoundOpened = soundInit();
 
     bool failed = false;
 
@@ -999,12 +1441,26 @@ int main(int argc, char **argv)
       exit(-1);
     }
 
+	// patches may have to grow the ROM buffer, a mapped file can't be
+	for (int i = 0; i < patchNum; i++)
+		if (FileExists(patchNames[i]))
+			cpuRomMapEnabled = false;
+
+	if (romPaging)
+		cpuRomPagingDir = sdlRomPagingDir();
+
+	if (romCacheDir) {
+		mkdir(romCacheDir, 0755);
+		cpuRomCacheDir = romCacheDir;
+		cpuRomCacheSize = (uint64_t)romCacheSize << 20;
+	}
+
 	int size = CPULoadRom(szFile);
 	failed = (size == 0);
 	if(!failed) 
 	{
 		if (cpuSaveType == 0)
-			utilGBAFindSave(size);
+			sdlFindSaveType(size);
 		else
 			saveType = cpuSaveType;
 
@@ -1020,6 +1476,8 @@ int main(int argc, char **argv)
           fprintf(stdout, "Trying patch %s%s\n", patchNames[patchnum],
             applyPatch(patchNames[patchnum], &rom, &size) ? " [success]" : "");
         }
+        // reads past the original end have to see what the patches added
+        CPUSetRomSize(size);
         CPUReset();
 	}
 
@@ -1028,7 +1486,7 @@ int main(int argc, char **argv)
       exit(-1);
     }
   } else {
-    soundInit();
+    sdlSoundOpened = soundInit();
     strcpy(filename, "gnu_stub");
     rom = (uint8_t *)malloc(0x2000000);
     workRAM = (uint8_t *)calloc(1, 0x40000);
@@ -1049,18 +1507,26 @@ int main(int argc, char **argv)
   sdlReadBattery();
 
 
-  int flags = SDL_INIT_VIDEO|SDL_INIT_AUDIO;
+  // --benchmark runs without a window, an audio device or input
+  int flags = benchmarkFrames ? 0 : SDL_INIT_VIDEO|SDL_INIT_AUDIO;
 
   if(SDL_Init(flags)) {
     systemMessage(0, "Failed to init SDL: %s", SDL_GetError());
     exit(-1);
   }
 
-  if(SDL_InitSubSystem(SDL_INIT_JOYSTICK)) {
-    systemMessage(0, "Failed to init joystick support: %s", SDL_GetError());
-  }
+  if(benchmarkFrames)
+    autoFrameSkip = 0;
+  else {
+    // auto frameskip works from what rendering costs
+    cpuTimingEnabled = autoFrameSkip != 0;
 
-  inputInitJoysticks();
+    if(SDL_InitSubSystem(SDL_INIT_JOYSTICK)) {
+      systemMessage(0, "Failed to init joystick support: %s", SDL_GetError());
+    }
+
+    inputInitJoysticks();
+  }
 
 	sizeX = 240;
 	sizeY = 160;
@@ -1087,21 +1553,83 @@ int main(int argc, char **argv)
   renderedFrames = 0;
 
   autoFrameSkipLastTime = throttleLastTime = systemGetClock();
+  Sm60FPS_Init();
 
   SDL_WM_SetCaption("VBA-M", NULL);
 
+  if(soundRecordDir && *soundRecordDir)
+    sdlStartSoundRecording();
+
+  if(moviePlayFile && *moviePlayFile) {
+    if(!moviePlay(moviePlayFile))
+      exit(-1);
+    systemScreenMessage("Movie playing");
+  } else if(movieRecordDir && *movieRecordDir)
+    sdlStartMovieRecording(false);
+
+  if(soundThread)
+    sdlSoundThreadStart();
+
+  if(rewindMemory)
+    sdlRewind.reset(rewindMemory, REWIND_NUM * REWIND_SIZE);
+
+  sdlWriter.start();
+
+  if(presentThread && !benchmarkFrames)
+    sdlPresentThreadStart();
+
+  cpuKeyInputPolling = pollKeyInput && !benchmarkFrames;
+
+  if(benchmarkFrames) {
+    sdlBenchmark(benchmarkFrames);
+    emulating = 0;
+  }
+
   while(emulating) 
   {
-    emulator.emuMain(emulator.emuCount);
+    if(sdlRewinding)
+      sdlRewindStep();
+    else if(runAhead && !movieRecording() && !moviePlaying())
+      // a movie would see the frames run ahead and thrown away
+      sdlRunAheadFrame();
+    else
+      emulator.emuMain(emulator.emuCount);
+
+    if(rewindSaveNeeded) {
+      rewindSaveNeeded = 0;
+      sdlRewind.capture(emulator);
+    }
+
     sdlPollEvents();
+    sdlCheckWriter();
   }
 
   emulating = 0;
   fprintf(stdout,"Shutting down\n");
+  sdlStopMovie();
+  if(moviePlayFile && *moviePlayFile) {
+    if(movieDesyncFrame() < 0)
+      fprintf(stdout, "Movie played %d frames in sync\n", movieFrame());
+    else
+      fprintf(stdout, "Movie played %d frames, out of sync from frame %d\n",
+              movieFrame(), movieDesyncFrame());
+  }
+  if(!benchmarkFrames)
+    sdlPrintFrameTimes();
+  if(romPaging)
+    sdlPrintRomBanks();
+  sdlSoundThreadStop();
+  sdlPresentThreadStop();
+  sdlStopSoundRecording();
+  sdlWriter.stop();
   soundShutdown();
 
+  free(sdlRunAheadState);
+  sdlRunAheadState = NULL;
+
   if(rom != NULL) {
-    sdlWriteBattery();
+    if(!benchmarkFrames)
+      sdlWriteBattery();
     emulator.emuCleanUp();
   }
 
@@ -1178,13 +1706,12 @@ static void bitmap_scale(uint32_t startx, uint32_t starty, uint32_t viswidth, ui
     } while (--H);
 }
 
-void systemDrawScreen()
+static void sdlPresent(const uint8_t *picture)
 {
 	uint16_t __restrict__ *src, *dst;
 	uint32_t pitch, y;
-	renderedFrames++;
-	
-	bitmap_scale(0, 0, 240, 160, real_video->w, real_video->h, 240, 0, (uint16_t*)pix, (uint16_t*)real_video->pixels);
+
+	bitmap_scale(0, 0, 240, 160, real_video->w, real_video->h, 240, 0, (uint16_t*)picture, (uint16_t*)real_video->pixels);
 /*
 	pitch = 320;
 	src = (uint16_t* __restrict__)pix;
@@ -1198,7 +1725,109 @@ void systemDrawScreen()
 		dst += pitch;
 	}
 */
-	SDL_Flip(real_video);
+	if (!benchmarkFrames)
+		SDL_Flip(real_video);
+}
+
+static int sdlPresentThreadMain(void *)
+{
+  while(!sdlPresentQuit) {
+    SDL_SemWait(sdlPresentWork);
+
+    if(!(__atomic_load_n(&sdlFrameReady, __ATOMIC_ACQUIRE) & SDL_FRAME_FRESH))
+      continue;
+
+    // take the newest picture, leave the one just shown to the core
+    sdlFramePresent = __atomic_exchange_n(&sdlFrameReady, sdlFramePresent,
+                                          __ATOMIC_ACQ_REL) & ~SDL_FRAME_FRESH;
+
+    SDL_mutexP(sdlPresentLock);
+    sdlPresent(sdlFrames[sdlFramePresent]);
+    SDL_mutexV(sdlPresentLock);
+  }
+
+  return 0;
+}
+
+static void sdlPresentThreadStart()
+{
+  for(int i = 0; i < 3; i++) {
+    sdlFrames[i] = (uint8_t *)calloc(1, 2 * 240 * 160);
+    if(!sdlFrames[i]) {
+      for(int j = 0; j < i; j++)
+        free(sdlFrames[j]);
+      systemMessage(0, "Failed to allocate memory for %s", "present thread");
+      return;
+    }
+  }
+
+  sdlFrameWrite = sdlFrameLast = 0;
+  sdlFramePresent = 1;
+  sdlFrameReady = 2;
+  memcpy(sdlFrames[0], pix, 2 * 240 * 160);
+
+  sdlPresentWork = SDL_CreateSemaphore(0);
+  sdlPresentLock = SDL_CreateMutex();
+  sdlPresentQuit = 0;
+
+  sdlPresentThread = SDL_CreateThread(sdlPresentThreadMain, NULL);
+  if(!sdlPresentThread) {
+    fprintf(stderr, "Failed to start present thread: %s\n", SDL_GetError());
+    SDL_DestroySemaphore(sdlPresentWork);
+    SDL_DestroyMutex(sdlPresentLock);
+    sdlPresentWork = NULL;
+    sdlPresentLock = NULL;
+    for(int i = 0; i < 3; i++)
+      free(sdlFrames[i]);
+    return;
+  }
+
+  sdlCorePix = pix;
+  pix = sdlFrames[sdlFrameWrite];
+}
+
+static void sdlPresentThreadStop()
+{
+  if(!sdlPresentThread)
+    return;
+
+  sdlPresentQuit = 1;
+  SDL_SemPost(sdlPresentWork);
+  SDL_WaitThread(sdlPresentThread, NULL);
+  sdlPresentThread = NULL;
+
+  // the core frees its own
+  memcpy(sdlCorePix, sdlFrames[sdlFrameLast], 2 * 240 * 160);
+  pix = sdlCorePix;
+  sdlCorePix = NULL;
+
+  for(int i = 0; i < 3; i++) {
+    free(sdlFrames[i]);
+    sdlFrames[i] = NULL;
+  }
+
+  SDL_DestroySemaphore(sdlPresentWork);
+  SDL_DestroyMutex(sdlPresentLock);
+  sdlPresentWork = NULL;
+  sdlPresentLock = NULL;
+}
+
+void systemDrawScreen()
+{
+  renderedFrames++;
+
+  if(!sdlPresentThread) {
+    sdlPresent(pix);
+    return;
+  }
+
+  sdlFrameLast = sdlFrameWrite;
+  sdlFrameWrite = __atomic_exchange_n(&sdlFrameReady, sdlFrameWrite | SDL_FRAME_FRESH,
+                                      __ATOMIC_ACQ_REL) & ~SDL_FRAME_FRESH;
+  pix = sdlFrames[sdlFrameWrite];
+
+  if(SDL_SemValue(sdlPresentWork) == 0)
+    SDL_SemPost(sdlPresentWork);
 }
 
 void systemSetTitle(const char *title)
@@ -1213,7 +1842,11 @@ void systemShowSpeed(int speed)
   showRenderedFrames = renderedFrames;
   renderedFrames = 0;
 
-  if(!fullScreen && showSpeed) {
+  if(!fullScreen && sdlFastForwarding) {
+    char buffer[80];
+    sprintf(buffer, "VBA-M - %.1fx", systemSpeed / 100.0);
+    systemSetTitle(buffer);
+  } else if(!fullScreen && showSpeed) {
     char buffer[80];
     if(showSpeed == 1)
       sprintf(buffer, "VBA-M - %d%%", systemSpeed);
@@ -1226,50 +1859,186 @@ void systemShowSpeed(int speed)
   }
 }
 
-void systemFrame()
+void Sm60FPS_Init()
 {
+  // a frame is 228 lines of 1232 cycles
+  sdlPacer.reset((double)TICKS_PER_SECOND / (228 * 1232) * (throttle ? throttle : 100) / 100);
 }
 
-void system10Frames(int rate)
+bool Sm60FPS_CanSkipFrame()
 {
-  uint32_t time = systemGetClock();
-  if(!wasPaused && autoFrameSkip) {
-    uint32_t diff = time - autoFrameSkipLastTime;
-    int speed = 100;
+  return sdlPacer.late();
+}
 
-    if(diff)
-      speed = (1000000/rate)/diff;
+void Sm60FPS_Sleep()
+{
+  // SoundSDL::write already holds the emulator back while sound plays
+  bool soundPaces = sdlSoundOpened && soundGetEnable() && !soundGetTimingOnly();
 
-    if(speed >= 98) {
-      frameskipadjust++;
+  if(throttle && !speedup && !benchmarkFrames && !soundPaces)
+    sdlPacer.wait();
+  else
+    sdlPacer.tick();
+}
 
-      if(frameskipadjust >= 3) {
-        frameskipadjust=0;
-        if(systemFrameSkip > 0)
-          systemFrameSkip--;
-      }
-    } else {
-      if(speed  < 80)
-        frameskipadjust -= (90 - speed)/5;
-      else if(systemFrameSkip < 9)
-        frameskipadjust--;
-
-      if(frameskipadjust <= -2) {
-        frameskipadjust += 2;
-        if(systemFrameSkip < 9)
-          systemFrameSkip++;
-      }
+// Percentiles of the time between frames, at exit
+static void sdlPrintFrameTimes()
+{
+  if(!sdlPacer.frames())
+    return;
+
+  fprintf(stdout, "Frame times over %u frames: 50%% %.2f ms, 99%% %.2f ms, 99.9%% %.2f ms, max %.2f ms\n",
+          sdlPacer.frames(), sdlPacer.percentile(50) / 1000.0,
+          sdlPacer.percentile(99) / 1000.0, sdlPacer.percentile(99.9) / 1000.0,
+          sdlPacer.percentile(100) / 1000.0);
+}
+
+// Auto frameskip: what a frame took since the last one woke up, split
+// into rendering and the rest from cpuTiming[], halfway averaged so a
+// busy scene shows within a frame or two. Sound synthesis is emulation,
+// only waiting on the sound device is left out.
+static uint64_t sdlFrameStart = 0;
+static uint64_t sdlFrameTiming[TIMING_COUNT];
+static uint64_t sdlEmulationCost = 0;
+static uint64_t sdlLineCost = 0; // renderLine and conversion, a whole frame
+static uint64_t sdlPresentCost = 0;
+
+static void sdlAutoFrameSkip()
+{
+  uint64_t delta[TIMING_COUNT];
+  for(int i = 0; i < TIMING_COUNT; i++) {
+    delta[i] = cpuTiming[i] - sdlFrameTiming[i];
+    sdlFrameTiming[i] = cpuTiming[i];
+  }
+
+  // a pause in between is nobody's cost
+  if(!sdlFrameStart || wasPaused) {
+    wasPaused = false;
+    return;
+  }
+
+  uint64_t busy = CPUTimingNow() - sdlFrameStart;
+  uint64_t lines = delta[TIMING_RENDER] + delta[TIMING_CONVERT];
+  uint64_t other = lines + delta[TIMING_PRESENT] + delta[TIMING_SOUND_WAIT];
+
+  sdlEmulationCost = (sdlEmulationCost + (busy > other ? busy - other : 0)) / 2;
+  if(lines)
+    sdlLineCost = (sdlLineCost + lines) / 2;
+  if(delta[TIMING_PRESENT])
+    sdlPresentCost = (sdlPresentCost + delta[TIMING_PRESENT]) / 2;
+
+  // Skipping only helps when emulation alone fits in a frame and
+  // rendering is what pushes it over; then skip just enough frames that
+  // (skip + 1) frames of spare time pay for one rendered
+  uint64_t budget = sdlPacer.period() * 95 / 100;
+  uint64_t render = sdlLineCost + sdlPresentCost;
+  int skip = 0;
+
+  if(sdlEmulationCost < budget && sdlEmulationCost + render > budget) {
+    uint64_t spare = budget - sdlEmulationCost;
+    skip = (int)((render + spare - 1) / spare) - 1;
+    if(skip > 9)
+      skip = 9;
+  }
+  systemFrameSkip = skip;
+}
+
+// Fast forward runs unpaced and draws about one frame per refresh,
+// however fast the core goes. Sound is not synthesized at all, or with
+// --fast-forward-audio one frame's worth is played per frame drawn, so
+// what plays is the game sped up with the gaps cut out rather than
+// pitched up.
+static uint64_t sdlFastForwardStart = 0;
+static uint64_t sdlFastForwardLast = 0;
+static uint64_t sdlFastForwardInterval = 0; // averaged time per frame
+static unsigned sdlFastForwardFrames = 0;
+
+static void sdlFastForward()
+{
+  // SDL 1.2 can't tell the display's rate, assume it is the GBA's
+  const uint64_t period = (uint64_t)(1e9 * 228 * 1232 / TICKS_PER_SECOND);
+  uint64_t now = CPUTimingNow();
+
+  if(!speedup) {
+    if(sdlFastForwarding) {
+      sdlFastForwarding = false;
+      if(fastForwardAudio)
+        soundSetDecimation(1);
+      else
+        soundSetTimingOnly(false);
+      if(now > sdlFastForwardStart)
+        fprintf(stdout, "Fast forward: %u frames at %.1fx\n", sdlFastForwardFrames,
+                (double)sdlFastForwardFrames * period / (now - sdlFastForwardStart));
     }
+    return;
+  }
+
+  if(!sdlFastForwarding) {
+    sdlFastForwarding = true;
+    sdlFastForwardStart = sdlFastForwardLast = now;
+    sdlFastForwardInterval = period;
+    sdlFastForwardFrames = 0;
+    // synthesis stays on for the audio, toggling it would click
+    if(!fastForwardAudio)
+      soundSetTimingOnly(true);
+    return;
   }
-  if(systemSaveUpdateCounter) {
+
+  // a pause or a stall shouldn't stop drawing for long
+  uint64_t interval = now - sdlFastForwardLast;
+  if(interval > period)
+    interval = period;
+  sdlFastForwardLast = now;
+  sdlFastForwardFrames++;
+  sdlFastForwardInterval = (sdlFastForwardInterval * 7 + interval) / 8;
+
+  int skip = 0;
+  if(sdlFastForwardInterval)
+    skip = (int)((period + sdlFastForwardInterval / 2) / sdlFastForwardInterval) - 1;
+  if(skip < 0)
+    skip = 0;
+  if(skip > 119)
+    skip = 119;
+  cpuSpeedupFrameSkip = skip;
+
+  if(fastForwardAudio)
+    soundSetDecimation(skip + 1);
+}
+
+void systemFrame()
+{
+  sdlFrameCount++;
+
+  if(sdlRunAheadHidden)
+    return;
+
+  if(speedup || sdlFastForwarding)
+    sdlFastForward();
+  else if(autoFrameSkip && throttle)
+    sdlAutoFrameSkip();
+
+  Sm60FPS_Sleep();
+  sdlFrameStart = CPUTimingNow();
+
+  if(rewindTimer && ++rewindCounter >= rewindTimer) {
+    rewindCounter = 0;
+    rewindSaveNeeded = 1;
+  }
+}
+
+void system10Frames(int rate)
+{
+  // run-ahead frames are undone again; the battery must not see them
+  if(sdlRunAheadHidden)
+    return;
+
+  // a benchmark leaves the save alone
+  if(systemSaveUpdateCounter && !benchmarkFrames) {
     if(--systemSaveUpdateCounter <= SYSTEM_SAVE_NOT_UPDATED) {
       sdlWriteBattery();
       systemSaveUpdateCounter = SYSTEM_SAVE_NOT_UPDATED;
     }
   }
-
-  wasPaused = false;
-  autoFrameSkipLastTime = time;
 }
 
 void systemScreenCapture(int a)
@@ -1284,7 +2053,7 @@ void systemScreenCapture(int a)
     else
       sprintf(buffer, "%s%02d.bmp", filename, a);
 
-    emulator.emuWriteBMP(buffer);
+    sdlWriter.writeBMP(buffer, sdlCapturePicture(), 240, 160);
   } else {
     if(screenShotDir)
       sprintf(buffer, "%s/%s%02d.png", screenShotDir, sdlGetFilename(filename), a);
@@ -1292,7 +2061,7 @@ void systemScreenCapture(int a)
       sprintf(buffer, "%s/%s/%s%02d.png", homeDir, DOT_DIR, sdlGetFilename(filename), a);
     else
       sprintf(buffer, "%s%02d.png", filename, a);
-    emulator.emuWritePNG(buffer);
+    sdlWriter.writePNG(buffer, sdlCapturePicture(), 240, 160);
   }
 
   systemScreenMessage("Screen capture");
@@ -1364,11 +2133,40 @@ bool systemPauseOnFrame()
 		pauseNextFrame = false;
 		return true;
 	}
+	// stop on this frame boundary so the main loop can take the snapshot,
+	// or run-ahead its state
+	if(rewindSaveNeeded || runAhead)
+		return true;
 	return false;
 }
 
+// Applies the key and joystick events waiting in SDL's queue without
+// taking them off it. sdlPollEvents still gets them for the hotkeys, and
+// going over them again there leaves the pad the same. At most once a
+// millisecond, for games that keep reading KEYINPUT.
+static void sdlPumpInput()
+{
+	static uint32_t lastPump = 0;
+	uint32_t now = SDL_GetTicks();
+
+	if(now == lastPump)
+		return;
+	lastPump = now;
+
+	SDL_Event events[64];
+	SDL_PumpEvents();
+	int n = SDL_PeepEvents(events, 64, SDL_PEEKEVENT,
+	                       SDL_KEYDOWNMASK | SDL_KEYUPMASK | SDL_JOYEVENTMASK);
+	for(int i = 0; i < n; i++)
+		inputProcessSDLEvent(events[i]);
+}
+
 bool systemReadJoypads()
 {
+	// sdlPollEvents only runs between emuMain calls, up to a frame ago;
+	// catch up on input right before the core latches it
+	if(!sdlRunAheadHidden && !benchmarkFrames)
+		sdlPumpInput();
 	return true;
 }
 
@@ -1376,6 +2174,11 @@ uint32_t systemReadJoypad(int which)
 {
 	return inputReadJoypad(which);
 }
+
+uint32_t systemPollJoypad(int which)
+{
+	return inputReadJoypad(which, false);
+}
 //static uint8_t sensorDarkness = 0xE8; // total darkness (including daylight on rainy days)
 
 void systemUpdateSolarSensor()
@@ -1412,10 +2215,24 @@ uint8_t systemGetSensorDarkness()
 	return 0;
 }
 
+// Takes the samples and drops them, so --benchmark still synthesizes
+// sound without an audio device or its throttling
+class SoundNull : public SoundDriver
+{
+public:
+	bool init(long sampleRate) { return true; }
+	void pause() {}
+	void reset() {}
+	void resume() {}
+	void write(uint16_t *finalWave, int length) {}
+};
+
 SoundDriver * systemSoundInit()
 {
 	soundShutdown();
 
+	if (benchmarkFrames)
+		return new SoundNull();
 	return new SoundSDL();
 }
 
@@ -1423,8 +2240,22 @@ void systemOnSoundShutdown()
 {
 }
 
+void systemSoundThreadNotify()
+{
+  if(sdlSoundThreadWork && SDL_SemValue(sdlSoundThreadWork) == 0)
+    SDL_SemPost(sdlSoundThreadWork);
+}
+
+void systemSoundThreadWait()
+{
+  if(sdlSoundThreadDone)
+    SDL_SemWaitTimeout(sdlSoundThreadDone, 10);
+}
+
 void systemOnWriteDataToSoundBuffer(const uint16_t * finalWave, int length)
 {
+  if(soundRecording)
+    sdlSoundRecorder.write(finalWave, length);
 }
 
 void log(const char *defaultMsg, ...)
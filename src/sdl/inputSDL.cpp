@@ -487,7 +487,7 @@ void inputProcessSDLEvent(const SDL_Event &event)
     }
 }
 
-uint32_t inputReadJoypad(int which)
+uint32_t inputReadJoypad(int which, bool advanceAutoFire)
 {
   int realAutoFire  = autoFire;
 
@@ -536,6 +536,9 @@ uint32_t inputReadJoypad(int which)
     res &= (~realAutoFire);
     if(autoFireToggle)
       res |= realAutoFire;
+  }
+
+  if(realAutoFire && advanceAutoFire) {
     autoFireCountdown--; // this needs decrementing even when autoFireToggle is toggled,
     // so that autoFireMaxCount==1 (the default) will alternate at the maximum possible
     // frequency (every time this code is reached). Which is what it did before
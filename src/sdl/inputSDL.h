@@ -103,9 +103,11 @@ uint32_t inputGetEventCode(const SDL_Event& event);
 /**
  * Read the state of an emulated joypad
  * @param which Emulated joypad index
+ * @param advanceAutoFire Whether this read counts towards autofire's
+ *                        alternation, false for reads between frames
  * @return Joypad state
  */
-uint32_t inputReadJoypad(int which);
+uint32_t inputReadJoypad(int which, bool advanceAutoFire = true);
 
 /**
  * Compute the motion sensor X and Y values